@@ -24,8 +24,15 @@
 #include <KLocalizedString>
 
 #include <QDir>
+#include <QFileInfo>
+#include <QRandomGenerator>
 #include <QSaveFile>
 
+#include <QtConcurrent>
+
+#include <cstring>
+#include <limits>
+
 #include "juktag.h"
 #include "searchplaylist.h"
 #include "historyplaylist.h"
@@ -39,7 +46,7 @@
 using namespace ActionCollection;
 
 const int Cache::playlistListCacheVersion = 3;
-const int Cache::playlistItemsCacheVersion = 2;
+const int Cache::playlistItemsCacheVersion = 3;
 
 enum PlaylistType
 {
@@ -50,6 +57,101 @@ enum PlaylistType
     Folder   = 4
 };
 
+// Layout of the version 3 collection cache.  The file is memory-mapped when
+// loading, so everything is stored in host byte order: a header, one
+// fixed-size record per track, and then a pool of deduplicated UTF-16 strings
+// which the records point into.  Each pooled string is prefixed with its
+// length, stored as two UTF-16 code units (low half first).
+
+static const char cacheMagic[8] = { 'J', 'u', 'K', 'C', 'a', 'c', 'h', 'e' };
+static const quint32 cacheByteOrderMark = 0x01020304;
+static const qint64 invalidModificationTime = std::numeric_limits<qint64>::min();
+
+struct CacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 byteOrderMark;
+    quint32 recordSize;
+    quint32 recordCount;
+    quint64 stringPoolOffset; // in bytes, from the start of the file
+    quint64 stringPoolSize;   // in UTF-16 code units
+    quint64 fileSize;
+    quint64 generation;       // matched against the journal
+};
+
+// String fields are offsets into the string pool, in UTF-16 code units.
+struct CacheRecord
+{
+    quint32 path;
+    quint32 title;
+    quint32 artist;
+    quint32 album;
+    quint32 genre;
+    quint32 comment;
+    quint32 lengthString;
+    qint32 track;
+    qint32 year;
+    qint32 bitrate;
+    qint32 seconds;
+    quint32 reserved;
+    qint64 modificationTime; // msecs since epoch
+};
+
+// Changes made after the cache was written are appended to a journal, a
+// QDataStream of JournalOperation entries following a short header naming the
+// generation of the cache they apply to.  A journal from any other generation
+// is stale and gets thrown away.
+
+static const quint32 journalMagic = 0x4A754B4A; // "JuKJ"
+static const qint32 journalVersion = 1;
+
+// Once the journal passes this size, or a quarter of the size of the cache,
+// whichever is larger, the cache is rewritten in full.
+static const qint64 minimumJournalCompactionSize = 256 * 1024;
+
+enum JournalOperation
+{
+    JournalUpdate = 1,
+    JournalRemove = 2
+};
+
+static_assert(sizeof(CacheHeader) % alignof(CacheRecord) == 0,
+        "Cache records must be aligned when the file is mapped");
+static_assert(sizeof(CacheRecord) % alignof(CacheRecord) == 0,
+        "Cache records must be aligned when the file is mapped");
+
+/**
+ * Builds the string pool of a version 3 cache, storing each distinct string
+ * only once.
+ */
+class CacheStringPool
+{
+public:
+    quint32 add(const QString &str)
+    {
+        const auto it = m_offsets.constFind(str);
+        if(it != m_offsets.cend())
+            return *it;
+
+        const quint32 offset = m_pool.size();
+        const quint32 length = str.size();
+
+        m_pool.append(QChar(char16_t(length & 0xFFFF)));
+        m_pool.append(QChar(char16_t(length >> 16)));
+        m_pool.append(str);
+
+        m_offsets.insert(str, offset);
+        return offset;
+    }
+
+    const QString &data() const { return m_pool; }
+
+private:
+    QHash<QString, quint32> m_offsets;
+    QString m_pool;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -225,6 +327,153 @@ void Cache::savePlaylists(const PlaylistList &playlists)
         qCCritical(JUK_LOG) << "Error saving collection:" << f.errorString();
 }
 
+bool Cache::saveItems(const CacheEntryList &entries, quint64 generation) // static
+{
+    QSaveFile f(fileHandleCacheFileName());
+
+    if(!f.open(QIODevice::WriteOnly)) {
+        qCCritical(JUK_LOG) << "Error saving cache:" << f.errorString();
+        return false;
+    }
+
+    CacheStringPool strings;
+    QVector<CacheRecord> records;
+    records.reserve(entries.size());
+
+    for(const auto &entry : entries) {
+        const Tag &tag = entry.tag;
+
+        CacheRecord record;
+        std::memset(&record, 0, sizeof(record));
+
+        record.path         = strings.add(entry.path);
+        record.title        = strings.add(tag.title());
+        record.artist       = strings.add(tag.artist());
+        record.album        = strings.add(tag.album());
+        record.genre        = strings.add(tag.genre());
+        record.comment      = strings.add(tag.comment());
+        record.lengthString = strings.add(tag.lengthString());
+        record.track        = tag.track();
+        record.year         = tag.year();
+        record.bitrate      = tag.bitrate();
+        record.seconds      = tag.seconds();
+        record.modificationTime = entry.lastModified.isValid()
+            ? entry.lastModified.toMSecsSinceEpoch()
+            : invalidModificationTime;
+
+        records.append(record);
+    }
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+
+    header.version          = playlistItemsCacheVersion;
+    header.byteOrderMark    = cacheByteOrderMark;
+    header.recordSize       = sizeof(CacheRecord);
+    header.recordCount      = records.size();
+    header.stringPoolOffset = sizeof(CacheHeader) + quint64(records.size()) * sizeof(CacheRecord);
+    header.stringPoolSize   = strings.data().size();
+    header.fileSize         = header.stringPoolOffset + header.stringPoolSize * sizeof(char16_t);
+    header.generation       = generation;
+
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(records.constData()),
+            qint64(records.size()) * sizeof(CacheRecord));
+    f.write(reinterpret_cast<const char *>(strings.data().constData()),
+            qint64(strings.data().size()) * sizeof(char16_t));
+
+    if(!f.commit()) {
+        qCCritical(JUK_LOG) << "Error saving cache:" << f.errorString();
+        return false;
+    }
+
+    // Everything in the journal is part of the new cache now.  Should we fail
+    // to remove it, it no longer matches the generation and is dropped on load.
+
+    QFile::remove(fileHandleJournalFileName());
+    return true;
+}
+
+quint64 Cache::newGeneration() // static
+{
+    quint64 generation;
+    do {
+        generation = QRandomGenerator::global()->generate64();
+    } while(generation == 0);
+
+    return generation;
+}
+
+void Cache::appendToJournal(const CacheEntryList &changed, const QStringList &removed)
+{
+    if(!m_generation || (changed.isEmpty() && removed.isEmpty()))
+        return;
+
+    QFile f(fileHandleJournalFileName());
+
+    if(!f.open(QIODevice::ReadWrite)) {
+        qCCritical(JUK_LOG) << "Error saving cache journal:" << f.errorString();
+        return;
+    }
+
+    // A journal left over from another version or generation of the cache
+    // would have these entries thrown away (or applied to the wrong cache)
+    // when it's loaded, so start it over.
+
+    if(f.size() > 0) {
+        QDataStream header(&f);
+        header.setVersion(QDataStream::Qt_4_3);
+
+        quint32 magic;
+        qint32 version;
+        quint64 generation;
+        header >> magic >> version >> generation;
+
+        if(header.status() != QDataStream::Ok || magic != journalMagic ||
+           version != journalVersion || generation != m_generation)
+        {
+            qCWarning(JUK_LOG) << "Discarding stale music cache journal";
+            f.resize(0);
+        }
+    }
+
+    f.seek(f.size());
+
+    // Build the entries up front so that they're appended with a single write.
+
+    QByteArray data;
+    QDataStream s(&data, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_4_3);
+
+    if(f.size() == 0)
+        s << journalMagic << journalVersion << m_generation;
+
+    for(const auto &path : removed)
+        s << qint8(JournalRemove) << path;
+
+    for(const auto &entry : changed) {
+        s << qint8(JournalUpdate) << entry.path
+          << entry.tag << entry.lastModified;
+    }
+
+    // A partly written entry would hide everything appended after it, have
+    // the whole cache rewritten instead.
+
+    if(f.write(data) != data.size() || !f.flush()) {
+        qCCritical(JUK_LOG) << "Error saving cache journal:" << f.errorString();
+        m_generation = 0;
+    }
+}
+
+bool Cache::journalNeedsCompaction() const
+{
+    const qint64 journalSize = QFileInfo(fileHandleJournalFileName()).size();
+    const qint64 cacheSize = QFileInfo(fileHandleCacheFileName()).size();
+
+    return journalSize > qMax(minimumJournalCompactionSize, cacheSize / 4);
+}
+
 void Cache::ensureAppDataStorageExists() // static
 {
     QString dirPath = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
@@ -246,11 +495,21 @@ QString Cache::fileHandleCacheFileName() // static
     return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/cache";
 }
 
+QString Cache::fileHandleJournalFileName() // static
+{
+    return fileHandleCacheFileName() + ".journal";
+}
+
 QString Cache::playlistsCacheFileName() // static
 {
     return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/playlists";
 }
 
+QString Cache::directoryIndexFileName() // static
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/directories";
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -266,6 +525,12 @@ bool Cache::prepareToLoadCachedItems()
     if(!m_loadFile.open(QIODevice::ReadOnly))
         return false;
 
+    if(m_loadFile.peek(sizeof(cacheMagic)) == QByteArray(cacheMagic, sizeof(cacheMagic)))
+        return prepareToLoadMappedItems();
+
+    // Older caches are QDataStreams, read them in full so that they can be
+    // written back out in the current format.
+
     m_loadDataStream.setDevice(&m_loadFile);
 
     int dataStreamVersion = CacheDataStream::Qt_3_3;
@@ -319,6 +584,50 @@ bool Cache::prepareToLoadCachedItems()
     return true;
 }
 
+QFuture<FileHandleList> Cache::loadCachedItemsConcurrently()
+{
+    // Small enough that the GUI thread can insert a batch without stalling
+    // the event loop for long, large enough to keep the workers busy.
+    static const quint32 recordsPerBatch = 1024;
+
+    QVector<QPair<quint32, quint32>> batches;
+    batches.reserve(m_recordCount / recordsPerBatch + 1);
+
+    for(quint32 first = 0; first < m_recordCount; first += recordsPerBatch) {
+        batches.append(qMakePair(first, qMin(first + recordsPerBatch, m_recordCount)));
+    }
+
+    return QtConcurrent::mapped(std::move(batches),
+        [this](const QPair<quint32, quint32> &batch) {
+            return loadMappedItems(batch.first, batch.second);
+        });
+}
+
+FileHandleList Cache::journaledItems() const
+{
+    FileHandleList files;
+
+    for(const auto &file : m_journal) {
+        if(!file.isNull())
+            files.append(file);
+    }
+
+    return files;
+}
+
+void Cache::completedLoadingCachedItems()
+{
+    if(m_map)
+        m_loadFile.unmap(m_map);
+    m_loadFile.close();
+
+    m_map = nullptr;
+    m_stringPool = nullptr;
+    m_stringPoolSize = 0;
+    m_recordCount = 0;
+    m_journal.clear();
+}
+
 FileHandle Cache::loadNextCachedItem()
 {
     if(!m_loadFile.isOpen() || !m_loadDataStream.device()) {
@@ -346,4 +655,216 @@ FileHandle Cache::loadNextCachedItem()
     }
 }
 
+bool Cache::prepareToLoadMappedItems()
+{
+    const qint64 fileSize = m_loadFile.size();
+    CacheHeader header;
+
+    if(fileSize < qint64(sizeof(header)) ||
+       m_loadFile.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header))
+    {
+        qCCritical(JUK_LOG) << "Music cache is truncated";
+        m_loadFile.close();
+        return false;
+    }
+
+    // A cache written on a host with a different byte order (or by a newer
+    // JuK) is simply rebuilt by rescanning.
+
+    if(header.version != quint32(playlistItemsCacheVersion) ||
+       header.byteOrderMark != cacheByteOrderMark ||
+       header.recordSize != sizeof(CacheRecord))
+    {
+        qCWarning(JUK_LOG) << "Music cache version" << header.version << "is not supported";
+        m_loadFile.close();
+        return false;
+    }
+
+    const quint64 recordsEnd = sizeof(CacheHeader) + quint64(header.recordCount) * sizeof(CacheRecord);
+
+    if(header.fileSize != quint64(fileSize) ||
+       header.stringPoolOffset != recordsEnd ||
+       header.stringPoolOffset + header.stringPoolSize * sizeof(char16_t) != header.fileSize)
+    {
+        qCCritical(JUK_LOG) << "Music cache header does not match the file size";
+        m_loadFile.close();
+        KMessageBox::error(0, i18n("The music data cache has been corrupted. JuK "
+                                   "needs to rescan it now. This may take some time."));
+        return false;
+    }
+
+    m_map = m_loadFile.map(0, fileSize);
+    if(!m_map) {
+        qCCritical(JUK_LOG) << "Unable to map music cache:" << m_loadFile.errorString();
+        m_loadFile.close();
+        return false;
+    }
+
+    m_stringPool = reinterpret_cast<const char16_t *>(m_map + header.stringPoolOffset);
+    m_stringPoolSize = header.stringPoolSize;
+    m_recordCount = header.recordCount;
+    m_generation = header.generation;
+
+    loadJournal();
+
+    return true;
+}
+
+void Cache::loadJournal()
+{
+    QFile f(fileHandleJournalFileName());
+    if(!f.open(QIODevice::ReadOnly))
+        return;
+
+    CacheDataStream s(&f);
+    s.setVersion(QDataStream::Qt_4_3);
+    s.setCacheVersion(1);
+
+    quint32 magic;
+    qint32 version;
+    quint64 generation;
+    s >> magic >> version >> generation;
+
+    if(s.status() != QDataStream::Ok || magic != journalMagic ||
+       version != journalVersion || generation != m_generation)
+    {
+        qCWarning(JUK_LOG) << "Discarding stale music cache journal";
+        f.close();
+        QFile::remove(fileHandleJournalFileName());
+        return;
+    }
+
+    // Later entries win.  A truncated or corrupt entry (e.g. from a crash
+    // while appending) can't be skipped, so it's ignored along with anything
+    // after it.
+
+    bool damaged = false;
+
+    while(!s.atEnd()) {
+        qint8 operation;
+        QString path;
+        s >> operation >> path;
+
+        if(s.status() != QDataStream::Ok || path.isEmpty()) {
+            damaged = true;
+            break;
+        }
+
+        if(operation == JournalRemove) {
+            m_journal.insert(path, FileHandle());
+            continue;
+        }
+
+        if(operation != JournalUpdate) {
+            damaged = true;
+            break;
+        }
+
+        Tag *tag = new Tag(path, true);
+        QDateTime modified;
+        s >> *tag >> modified;
+
+        if(s.status() != QDataStream::Ok) {
+            delete tag;
+            damaged = true;
+            break;
+        }
+
+        m_journal.insert(path, FileHandle(path, tag, modified));
+    }
+
+    // Anything appended after the damage would be dropped on the next load as
+    // well, so stop journaling.  Without a generation the next save rewrites
+    // the whole cache (and with it the journal), and the folders are listed
+    // again to find what was lost.
+
+    if(damaged) {
+        qCWarning(JUK_LOG) << "Music cache journal is damaged, the cache will be rewritten";
+        m_generation = 0;
+    }
+
+    qCDebug(JUK_LOG) << "Replaying" << m_journal.size() << "journaled music cache changes";
+}
+
+// Called from worker threads, anything touched here must be either local or
+// left alone until the load completes.
+FileHandleList Cache::loadMappedItems(quint32 first, quint32 last) const
+{
+    const auto records = reinterpret_cast<const CacheRecord *>(m_map + sizeof(CacheHeader));
+    SharedStringDict sharedStrings;
+    FileHandleList files;
+
+    files.reserve(last - first);
+
+    for(quint32 i = first; i < last; ++i) {
+        const CacheRecord &record = records[i];
+
+        QString path;
+        if(!readMappedString(record.path, &path) || path.isEmpty()) {
+            qCCritical(JUK_LOG) << "Music cache record" << i << "is corrupt";
+            continue;
+        }
+
+        // Superseded or removed by the journal
+        if(m_journal.contains(path))
+            continue;
+
+        Tag *tag = new Tag(path, true);
+
+        if(!readMappedString(record.title, &tag->m_title) ||
+           !readMappedString(record.artist, &tag->m_artist, &sharedStrings) ||
+           !readMappedString(record.album, &tag->m_album, &sharedStrings) ||
+           !readMappedString(record.genre, &tag->m_genre, &sharedStrings) ||
+           !readMappedString(record.comment, &tag->m_comment, &sharedStrings) ||
+           !readMappedString(record.lengthString, &tag->m_lengthString, &sharedStrings))
+        {
+            qCCritical(JUK_LOG) << "Music cache record for" << path << "is corrupt";
+            delete tag;
+            continue;
+        }
+
+        tag->m_track   = record.track;
+        tag->m_year    = record.year;
+        tag->m_bitrate = record.bitrate;
+        tag->m_seconds = record.seconds;
+
+        const QDateTime modified = record.modificationTime == invalidModificationTime
+            ? QDateTime()
+            : QDateTime::fromMSecsSinceEpoch(record.modificationTime);
+
+        files.append(FileHandle(path, tag, modified));
+    }
+
+    return files;
+}
+
+// Strings which repeat across many tracks are only decoded once per batch, and
+// every record in the batch pointing to them shares the same QString.
+bool Cache::readMappedString(quint32 offset, QString *out, SharedStringDict *sharedStrings) const
+{
+    if(m_stringPoolSize < 2 || offset > m_stringPoolSize - 2)
+        return false;
+
+    if(sharedStrings) {
+        const auto it = sharedStrings->constFind(offset);
+        if(it != sharedStrings->cend()) {
+            *out = *it;
+            return true;
+        }
+    }
+
+    const char16_t *entry = m_stringPool + offset;
+    const quint32 length = quint32(entry[0]) | (quint32(entry[1]) << 16);
+
+    if(length > m_stringPoolSize - offset - 2)
+        return false;
+
+    *out = QString(reinterpret_cast<const QChar *>(entry + 2), length);
+
+    if(sharedStrings)
+        sharedStrings->insert(offset, *out);
+
+    return true;
+}
+
 // vim: set et sw=4 tw=0 sta:
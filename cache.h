@@ -22,10 +22,14 @@
 #include <QFile>
 #include <QBuffer>
 #include <QVector>
+#include <QHash>
+#include <QFuture>
+
+#include "filehandle.h"
+#include "juktag.h"
 
 class Playlist;
 class PlaylistCollection;
-class FileHandle;
 
 typedef QVector<Playlist *> PlaylistList;
 
@@ -47,6 +51,29 @@ private:
     int m_cacheVersion;
 };
 
+/**
+ * A copy of everything the collection cache stores about a track.  The
+ * strings are implicitly shared so this is cheap to make (no disk access),
+ * and unlike a FileHandle it can safely be handed to another thread to be
+ * written out.
+ */
+
+struct CacheEntry
+{
+    explicit CacheEntry(const FileHandle &file) :
+        path(file.absFilePath()),
+        tag(file.tagSnapshot()),
+        lastModified(file.baseModificationTime())
+    {
+    }
+
+    QString path;
+    Tag tag;
+    QDateTime lastModified;
+};
+
+typedef QVector<CacheEntry> CacheEntryList;
+
 
 class Cache
 {
@@ -56,13 +83,71 @@ public:
     static void loadPlaylists(PlaylistCollection *collection);
     static void savePlaylists(const PlaylistList &playlists);
 
+    /**
+     * Writes \p entries as a complete collection cache identified by
+     * \p generation (see newGeneration()) and drops the journal of changes
+     * made on top of the previous one.  This may be called from any thread.
+     */
+    static bool saveItems(const CacheEntryList &entries, quint64 generation);
+
+    /**
+     * Returns a new identifier to write a complete collection cache with.
+     */
+    static quint64 newGeneration();
+
+    /**
+     * The generation of the collection cache on disk, or 0 if there is no
+     * cache in the current format yet.  Changes can only be journaled on top
+     * of an existing cache.
+     */
+    quint64 generation() const { return m_generation; }
+    void setGeneration(quint64 generation) { m_generation = generation; }
+
+    /**
+     * Appends added or changed items and removed paths to the journal kept
+     * next to the collection cache, which is replayed on top of it when it is
+     * loaded.
+     */
+    void appendToJournal(const CacheEntryList &changed, const QStringList &removed);
+
+    /**
+     * Returns true once the journal has grown large enough that the
+     * collection cache should be rewritten with saveItems().
+     */
+    bool journalNeedsCompaction() const;
+
     static void ensureAppDataStorageExists();
     static bool cacheFileExists();
 
     static QString fileHandleCacheFileName();
+    static QString fileHandleJournalFileName();
     static QString playlistsCacheFileName();
+    static QString directoryIndexFileName();
 
     bool prepareToLoadCachedItems();
+
+    /**
+     * Returns true if the cache prepared by prepareToLoadCachedItems() can be
+     * decoded with loadCachedItemsConcurrently(), otherwise the items must be
+     * read one at a time with loadNextCachedItem().
+     */
+    bool canLoadCachedItemsConcurrently() const { return m_map != nullptr; }
+
+    /**
+     * Decodes the cached items in chunks on the global thread pool.  Each
+     * result of the returned future is one batch of items.  Call
+     * completedLoadingCachedItems() once the future has finished.
+     */
+    QFuture<FileHandleList> loadCachedItemsConcurrently();
+
+    /**
+     * Returns the items added or changed by the journal, which are skipped
+     * by loadCachedItemsConcurrently().
+     */
+    FileHandleList journaledItems() const;
+
+    void completedLoadingCachedItems();
+
     FileHandle loadNextCachedItem();
 
     /**
@@ -73,9 +158,12 @@ public:
     static const int playlistListCacheVersion;
 
     /**
-     * QDataStream version for serialized list of playlist items in a playlist
+     * Version of the collection cache (the list of all known tracks)
      * 1: Original cache version
      * 2: KDE 4.0.1+, explicitly sets QDataStream encoding.
+     * 3: No longer a QDataStream.  A fixed-size record table followed by a
+     *    string pool, loaded with mmap, plus an append-only journal of
+     *    changes since it was written.  1 and 2 are still read for migration.
      */
     static const int playlistItemsCacheVersion;
 
@@ -83,10 +171,27 @@ private:
     // private to force access through instance()
     Cache();
 
+    typedef QHash<quint32, QString> SharedStringDict;
+
+    bool prepareToLoadMappedItems();
+    FileHandleList loadMappedItems(quint32 first, quint32 last) const;
+    bool readMappedString(quint32 offset, QString *out, SharedStringDict *sharedStrings = nullptr) const;
+    void loadJournal();
+
 private:
     QFile m_loadFile;
     QBuffer m_loadFileBuffer;
     CacheDataStream m_loadDataStream;
+
+    // Used when loading a version 3 cache
+    uchar *m_map = nullptr;
+    const char16_t *m_stringPool = nullptr;
+    quint64 m_stringPoolSize = 0;
+    quint32 m_recordCount = 0;
+
+    // Journaled changes, a null FileHandle marks a removed item
+    QHash<QString, FileHandle> m_journal;
+    quint64 m_generation = 0;
 };
 
 #endif
@@ -28,22 +28,29 @@
 #include <QDropEvent>
 #include <QElapsedTimer>
 #include <QFileInfo>
+#include <QFontMetrics>
+#include <QFutureWatcher>
 #include <QHeaderView>
 #include <QList>
 #include <QMenu>
 #include <QReadLocker>
-#include <QSaveFile>
 #include <QTime>
 #include <QTimer>
 #include <QWriteLocker>
 
+#include <QtConcurrent>
+
+#include <algorithm>
 #include <utility>
 
 #include "playlistcollection.h"
 #include "stringshare.h"
 #include "cache.h"
 #include "actioncollection.h"
+#include "directoryindex.h"
 #include "juktag.h"
+#include "searchindex.h"
+#include "trackstore.h"
 #include "viewmode.h"
 #include "juk_debug.h"
 
@@ -63,6 +70,50 @@ CollectionList *CollectionList::instance()
 
 static QElapsedTimer stopwatch;
 
+// Records that \p value of \p column came (or went), unless it had just gone
+// (or come) in the same transaction, in which case that is forgotten instead.
+static void recordTagChange(QHash<int, QSet<QString>> &undone, QHash<int, QSet<QString>> &done,
+                            int column, const QString &value)
+{
+    const auto it = undone.find(column);
+    if(it != undone.end() && it->remove(value)) {
+        if(it->isEmpty())
+            undone.erase(it);
+        return;
+    }
+
+    done[column].insert(value);
+}
+
+// Run on the thread pool by slotCheckCache(), the tag of anything modified
+// since it was cached is reread here as well.
+CollectionList::CachedItemChanges CollectionList::checkCachedItems(const QVector<CachedItemState> &items) // static
+{
+    CachedItemChanges changes;
+
+    for(const auto &item : items) {
+        const QFileInfo fileInfo(item.path);
+
+        if(!fileInfo.exists() || !fileInfo.isFile()) {
+            changes.removed.append(item.path);
+            continue;
+        }
+
+        if(item.baseModificationTime.isValid() &&
+           item.baseModificationTime >= fileInfo.lastModified())
+        {
+            continue;
+        }
+
+        FileHandle refreshed(fileInfo);
+        (void) refreshed.tag(); // Ensure tag is read
+
+        changes.refreshed.append(refreshed);
+    }
+
+    return changes;
+}
+
 void CollectionList::startLoadingCachedItems()
 {
     if(!m_list)
@@ -71,23 +122,46 @@ void CollectionList::startLoadingCachedItems()
     qCDebug(JUK_LOG) << "Starting to load cached items";
     stopwatch.start();
 
-    if(!Cache::instance()->prepareToLoadCachedItems()) {
+    Cache *cache = Cache::instance();
+
+    if(!cache->prepareToLoadCachedItems()) {
         qCCritical(JUK_LOG) << "Unable to setup to load cache... perhaps it doesn't exist?";
 
         completedLoadingCachedItems();
         return;
     }
 
-    QTimer::singleShot(0, this, &CollectionList::loadNextBatchCachedItems);
+    if(!cache->canLoadCachedItemsConcurrently()) {
+        QTimer::singleShot(0, this, &CollectionList::loadNextBatchCachedItems);
+        return;
+    }
+
+    // Batches are decoded on the thread pool, we only have to add the
+    // finished FileHandles as they come in.
+
+    auto loadWatcher = new QFutureWatcher<FileHandleList>(this);
+
+    connect(loadWatcher, &QFutureWatcher<FileHandleList>::resultReadyAt, this,
+        [this, loadWatcher](int index) {
+            addCachedItems(loadWatcher->resultAt(index));
+        });
+    connect(loadWatcher, &QFutureWatcher<FileHandleList>::finished, this,
+        [this, loadWatcher]() {
+            addCachedItems(Cache::instance()->journaledItems());
+            Cache::instance()->completedLoadingCachedItems();
+            loadWatcher->deleteLater();
+            completedLoadingCachedItems();
+        });
+
+    loadWatcher->setFuture(cache->loadCachedItemsConcurrently());
 }
 
 void CollectionList::loadNextBatchCachedItems()
 {
     Cache *cache = Cache::instance();
+    FileHandleList batch;
     bool done = false;
 
-    QReadLocker lock(&m_itemsDictLock);
-
     for(int i = 0; i < 127; ++i) {
         FileHandle cachedItem(cache->loadNextCachedItem());
 
@@ -96,18 +170,11 @@ void CollectionList::loadNextBatchCachedItems()
             break;
         }
 
-        // This may have already been created via a loaded playlist.
-        if(!m_itemsDict.contains(cachedItem.absFilePath())) {
-            lock.unlock();
-            CollectionListItem *newItem = new CollectionListItem(this, cachedItem);
-            lock.relock();
-
-            setupItem(newItem);
-        }
+        batch.append(cachedItem);
     }
 
-    // Whatever gets done here cannot be done as a direct call since we have
-    // the items dict locked
+    addCachedItems(batch);
+
     if(!done) {
         QTimer::singleShot(0, this, &CollectionList::loadNextBatchCachedItems);
     }
@@ -118,6 +185,9 @@ void CollectionList::loadNextBatchCachedItems()
 
 void CollectionList::completedLoadingCachedItems()
 {
+    // From here on changes to the collection need to be saved to the cache.
+    m_trackCacheChanges = true;
+
     // The CollectionList is created with sorting disabled for speed.  Re-enable
     // it here, and perform the sort.
     KConfigGroup config(KSharedConfig::openConfig(), "Playlists");
@@ -131,10 +201,49 @@ void CollectionList::completedLoadingCachedItems()
     qCDebug(JUK_LOG) << "Finished loading cached items, took" << stopwatch.elapsed() << "ms";
     qCDebug(JUK_LOG) << m_itemsDict.size() << "items are in the CollectionList";
     qCDebug(JUK_LOG) << StringShare::numHits() << "string intern hits out of" << StringShare::numAttempts() << "attempts";
+    qCDebug(JUK_LOG) << StringShare::size() << "distinct strings are shared, saving" << StringShare::bytesSaved() << "bytes";
+
+    // Folders are only skipped when rescanning if their files were in the
+    // cache just loaded.
+    DirectoryIndex::instance()->setCacheGeneration(Cache::instance()->generation());
 
     emit cachedItemsLoaded();
 }
 
+void CollectionList::addCachedItems(const FileHandleList &files)
+{
+    beginTransaction();
+
+    for(const auto &cachedItem : files) {
+        // This may have already been created via a loaded playlist.
+        if(!hasItem(cachedItem.absFilePath()))
+            setupItem(new CollectionListItem(this, cachedItem));
+    }
+
+    commitTransaction();
+}
+
+void CollectionList::trackAdded(TrackStore::Id id)
+{
+    m_changes.added.insert(id);
+}
+
+void CollectionList::trackRemoved(TrackStore::Id id)
+{
+    // The id may have been removed already and then reused for a new track
+    // within the same transaction, in which case it stays removed.
+
+    if(!m_changes.added.remove(id))
+        m_changes.removed.insert(id);
+    m_changes.changed.remove(id);
+}
+
+void CollectionList::trackChanged(TrackStore::Id id)
+{
+    if(!m_changes.added.contains(id))
+        m_changes.changed.insert(id);
+}
+
 void CollectionList::initialize(PlaylistCollection *collection)
 {
     if(m_list)
@@ -176,15 +285,6 @@ CollectionListItem *CollectionList::createItem(const FileHandle &file, QTreeWidg
     return item;
 }
 
-void CollectionList::clearItems(const PlaylistItemList &items)
-{
-    for(PlaylistItem *item : items) {
-        delete item;
-    }
-
-    playlistItemsChanged();
-}
-
 void CollectionList::setupTreeViewEntries(ViewMode *viewMode) const
 {
     TreeViewMode *treeViewMode = dynamic_cast<TreeViewMode *>(viewMode);
@@ -211,12 +311,17 @@ void CollectionList::slotNewItems(const KFileItemList &items)
         files.append(file.url().path());
     }
 
+    beginTransaction();
     addFiles(files);
+    commitTransaction();
+
     update();
 }
 
 void CollectionList::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> > &items)
 {
+    beginTransaction();
+
     for(int i = 0; i < items.count(); ++i) {
         const KFileItem fileItem = items[i].second;
         CollectionListItem *item = lookup(fileItem.url().path());
@@ -233,50 +338,78 @@ void CollectionList::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >
         }
     }
 
+    commitTransaction();
+
     update();
 }
 
 void CollectionList::slotDeleteItems(const KFileItemList &items)
 {
+    beginTransaction();
+
     for(const auto &item : items) {
         delete lookup(item.url().path());
     }
+
+    commitTransaction();
 }
 
-void CollectionList::saveItemsToCache() const
+void CollectionList::saveItemsToCache()
 {
     qCDebug(JUK_LOG) << "Saving collection list to cache";
 
-    QSaveFile f(Cache::fileHandleCacheFileName());
+    m_cacheSaveTimer->stop();
 
-    if(!f.open(QIODevice::WriteOnly)) {
-        qCCritical(JUK_LOG) << "Error saving cache:" << f.errorString();
-        return;
+    if(!m_cacheCompaction.isRunning()) {
+        if(Cache::instance()->generation())
+            journalCacheChanges();
+        else
+            compactCache(); // Nothing to journal against yet
     }
 
-    QByteArray data;
-    QDataStream s(&data, QIODevice::WriteOnly);
-    s.setVersion(QDataStream::Qt_4_3);
+    // We only get here on shutdown, the writer has to be done before we quit.
 
-    { // locked scope
-        QWriteLocker lock(&m_itemsDictLock);
+    m_cacheCompaction.waitForFinished();
+    completedCacheCompaction();
 
-        for(const auto &[key, v] : as_const(m_itemsDict).asKeyValueRange()) {
-            s << key;
-            s << v->file();
-        }
-    }
+    journalCacheChanges();
+}
 
-    QDataStream fs(&f);
+void CollectionList::beginTransaction()
+{
+    ++m_transactionDepth;
+}
 
-    qint32 checksum = qChecksum(data);
+void CollectionList::commitTransaction()
+{
+    if(--m_transactionDepth > 0 || m_changes.isEmpty())
+        return;
+
+    // The receivers may well change the collection again, so start over
+    // before telling them.
 
-    fs << qint32(Cache::playlistItemsCacheVersion)
-       << checksum
-       << data;
+    const CollectionChanges changes = std::exchange(m_changes, CollectionChanges());
 
-    if(!f.commit())
-        qCCritical(JUK_LOG) << "Error saving cache:" << f.errorString();
+    // The playlists holding a changed track show its new tag, which doesn't
+    // change their items but is still news to their listeners.
+
+    QSet<Playlist *> playlists;
+    for(TrackStore::Id id : changes.changed) {
+        const CollectionListItem *item = itemForTrack(id);
+        if(!item)
+            continue;
+
+        for(PlaylistItem *child : item->m_children)
+            playlists.insert(child->playlist());
+    }
+
+    for(Playlist *playlist : as_const(playlists))
+        playlist->playlistItemsChanged();
+
+    playlistItemsChanged();
+
+    emit signalCollectionUpdated(changes);
+    emit signalCollectionChanged();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -292,29 +425,74 @@ void CollectionList::clear()
              "your “scan on startup” list, they will be readded on startup."));
 
     if(result == KMessageBox::Continue) {
+        // Make sure that the next folder scan finds these again.
+        PlaylistItemList removedItems = selectedItems();
+        if(removedItems.isEmpty())
+            removedItems = items();
+
+        // The paths are already canonical, so there's no need to ask the
+        // disk for each file's directory.
+
+        QSet<QString> dirs;
+        for(const auto &item : as_const(removedItems)) {
+            const QString path = item->file().absFilePath();
+            dirs.insert(path.left(path.lastIndexOf('/')));
+        }
+
+        for(const auto &dir : as_const(dirs))
+            DirectoryIndex::instance()->remove(dir);
+
+        beginTransaction();
         Playlist::clear();
-        emit signalCollectionChanged();
+        commitTransaction();
     }
 }
 
 void CollectionList::slotCheckCache()
 {
-    PlaylistItemList invalidItems;
     qCDebug(JUK_LOG) << "Starting to check cached items for consistency";
     stopwatch.start();
 
+    // Only the paths and the times their tags were read are needed, the
+    // checking itself is done by the thread pool.  Going through the files in
+    // path order keeps the stat()s of each directory together.
+
+    QVector<CachedItemState> items;
+
     { // locked scope
-        QWriteLocker lock(&m_itemsDictLock);
+        QReadLocker lock(&m_itemsDictLock);
 
-        for(auto item : std::as_const(m_itemsDict)) {
-            if(!item->checkCurrent())
-                invalidItems.append(item);
-        }
+        items.reserve(m_itemsDict.size());
+        for(auto it = m_itemsDict.cbegin(); it != m_itemsDict.cend(); ++it)
+            items.append({ it.key(), it.value()->file().baseModificationTime() });
     }
 
-    clearItems(invalidItems);
+    std::sort(items.begin(), items.end(),
+        [](const CachedItemState &a, const CachedItemState &b) {
+            return a.path < b.path;
+        });
+
+    static const int itemsPerBatch = 256;
+
+    QVector<QVector<CachedItemState>> batches;
+    batches.reserve(items.size() / itemsPerBatch + 1);
 
-    qCDebug(JUK_LOG) << "Finished consistency check, took" << stopwatch.elapsed() << "ms";
+    for(int i = 0; i < items.size(); i += itemsPerBatch)
+        batches.append(items.mid(i, itemsPerBatch));
+
+    auto checkWatcher = new QFutureWatcher<CachedItemChanges>(this);
+
+    connect(checkWatcher, &QFutureWatcher<CachedItemChanges>::resultReadyAt, this,
+        [this, checkWatcher](int index) {
+            applyCachedItemChanges(checkWatcher->resultAt(index));
+        });
+    connect(checkWatcher, &QFutureWatcher<CachedItemChanges>::finished, this,
+        [checkWatcher]() {
+            checkWatcher->deleteLater();
+            qCDebug(JUK_LOG) << "Finished consistency check, took" << stopwatch.elapsed() << "ms";
+        });
+
+    checkWatcher->setFuture(QtConcurrent::mapped(std::move(batches), &CollectionList::checkCachedItems));
 }
 
 void CollectionList::slotRemoveItem(const QString &file)
@@ -349,9 +527,17 @@ CollectionList::CollectionList(PlaylistCollection *collection) :
             this, SLOT(slotPlayFromBackMenu(QAction*)));
     setSortingEnabled(false); // Temporarily disable sorting to add items faster.
 
-    m_columnTags[PlaylistItem::ArtistColumn] = new TagCountDict;
-    m_columnTags[PlaylistItem::AlbumColumn] = new TagCountDict;
-    m_columnTags[PlaylistItem::GenreColumn] = new TagCountDict;
+    m_columnTags[PlaylistItem::ArtistColumn] = new TagTracksDict;
+    m_columnTags[PlaylistItem::AlbumColumn] = new TagTracksDict;
+    m_columnTags[PlaylistItem::GenreColumn] = new TagTracksDict;
+
+    // Changes are usually made in bursts (tag edits, folder scans) so wait for
+    // things to settle before saving them.
+    m_cacheSaveTimer = new QTimer(this);
+    m_cacheSaveTimer->setSingleShot(true);
+    m_cacheSaveTimer->setInterval(5000);
+    connect(m_cacheSaveTimer, &QTimer::timeout,
+            this, &CollectionList::slotSaveCacheChanges);
 
     // Even set to true it wouldn't work with this class due to other checks
     setAllowDuplicates(false);
@@ -365,9 +551,15 @@ CollectionList::~CollectionList()
 
     // The CollectionListItems will try to remove themselves from the
     // m_columnTags member, so we must make sure they're gone before we
-    // are.
+    // are.  The cache has already been saved by now.
 
+    m_trackCacheChanges = false;
+    m_cacheSaveTimer->stop();
+    m_cacheCompaction.waitForFinished();
+
+    beginTransaction();
     clearItems(items());
+    commitTransaction();
 
     qDeleteAll(m_columnTags);
     m_columnTags.clear();
@@ -389,16 +581,34 @@ void CollectionList::dragMoveEvent(QDragMoveEvent *e)
         e->setAccepted(false);
 }
 
+void CollectionList::changeEvent(QEvent *e)
+{
+    // The widths measured so far don't hold for the new font.
+
+    if(e->type() == QEvent::FontChange)
+        TrackStore::instance()->clearTextWidths();
+
+    Playlist::changeEvent(e);
+}
+
 void CollectionList::addToDict(const QString &file, CollectionListItem *item)
 {
-    QWriteLocker lock(&m_itemsDictLock);
-    m_itemsDict.insert(file, item);
+    { // locked scope
+        QWriteLocker lock(&m_itemsDictLock);
+        m_itemsDict.insert(file, item);
+    }
+
+    cacheItemChanged(file);
 }
 
 void CollectionList::removeFromDict(const QString &file)
 {
-    QWriteLocker lock(&m_itemsDictLock);
-    m_itemsDict.remove(file);
+    { // locked scope
+        QWriteLocker lock(&m_itemsDictLock);
+        m_itemsDict.remove(file);
+    }
+
+    cacheItemRemoved(file);
 }
 
 bool CollectionList::hasItem(const QString &file) const
@@ -413,17 +623,18 @@ CollectionListItem *CollectionList::lookup(const QString &file) const
     return m_itemsDict.value(file, nullptr);
 }
 
-QString CollectionList::addStringToDict(const QString &value, int column)
+QString CollectionList::addStringToDict(const QString &value, int column, TrackStore::Id track)
 {
     if(column > m_columnTags.count() || value.trimmed().isEmpty())
         return QString();
 
-    if(m_columnTags[column]->contains(value))
-        ++((*m_columnTags[column])[value]);
-    else {
-        m_columnTags[column]->insert(value, 1);
-        emit signalNewTag(value, column);
-    }
+    QSet<TrackStore::Id> &tracks = (*m_columnTags[column])[value];
+    const bool isNew = tracks.isEmpty();
+
+    tracks.insert(track);
+
+    if(isNew)
+        recordTagChange(m_changes.removedTags, m_changes.newTags, column, value);
 
     return value;
 }
@@ -453,16 +664,21 @@ QStringList CollectionList::uniqueSet(UniqueSetType t) const
     return m_columnTags[column]->keys();
 }
 
-void CollectionList::removeStringFromDict(const QString &value, int column)
+void CollectionList::removeStringFromDict(const QString &value, int column, TrackStore::Id track)
 {
     if(column > m_columnTags.count() || value.trimmed().isEmpty())
         return;
 
-    if(m_columnTags[column]->contains(value) &&
-       --((*m_columnTags[column])[value])) // If the decrement goes to 0...
-    {
-        emit signalRemovedTag(value, column);
-        m_columnTags[column]->remove(value);
+    const auto it = m_columnTags[column]->find(value);
+    if(it == m_columnTags[column]->end())
+        return;
+
+    it->remove(track);
+
+    if(it->isEmpty()) {
+        m_columnTags[column]->erase(it);
+
+        recordTagChange(m_changes.newTags, m_changes.removedTags, column, value);
     }
 }
 
@@ -476,59 +692,227 @@ void CollectionList::removeWatched(const QString &file)
     m_dirWatch->removeFile(file);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+void CollectionList::applyCachedItemChanges(const CachedItemChanges &changes)
+{
+    beginTransaction();
+
+    PlaylistItemList removedItems;
+
+    for(const auto &file : changes.removed) {
+        CollectionListItem *item = lookup(file);
+        if(item)
+            removedItems.append(item);
+    }
+
+    if(!removedItems.isEmpty())
+        clearItems(removedItems);
+
+    for(const auto &file : changes.refreshed) {
+        CollectionListItem *item = lookup(file.absFilePath());
+        if(item)
+            item->setFile(file);
+    }
+
+    commitTransaction();
+}
+
+void CollectionList::cacheItemChanged(const QString &file)
+{
+    if(!m_trackCacheChanges)
+        return;
+
+    m_removedCacheItems.remove(file);
+    m_changedCacheItems.insert(file);
+    m_cacheSaveTimer->start();
+}
+
+void CollectionList::cacheItemRemoved(const QString &file)
+{
+    if(!m_trackCacheChanges)
+        return;
+
+    m_changedCacheItems.remove(file);
+    m_removedCacheItems.insert(file);
+    m_cacheSaveTimer->start();
+}
+
+CacheEntryList CollectionList::cacheEntries() const
+{
+    CacheEntryList entries;
+    QReadLocker lock(&m_itemsDictLock);
+
+    entries.reserve(m_itemsDict.size());
+    for(const auto &item : as_const(m_itemsDict))
+        entries.append(CacheEntry(item->file()));
+
+    return entries;
+}
+
+void CollectionList::journalCacheChanges()
+{
+    if(m_changedCacheItems.isEmpty() && m_removedCacheItems.isEmpty())
+        return;
+
+    CacheEntryList changed;
+    changed.reserve(m_changedCacheItems.size());
+
+    for(const auto &file : as_const(m_changedCacheItems)) {
+        const CollectionListItem *item = lookup(file);
+        if(item)
+            changed.append(CacheEntry(item->file()));
+    }
+
+    Cache::instance()->appendToJournal(changed, m_removedCacheItems.values());
+
+    m_changedCacheItems.clear();
+    m_removedCacheItems.clear();
+}
+
+void CollectionList::compactCache()
+{
+    // Taking the snapshot is the only part done on the GUI thread: the tracks
+    // are copied under the read lock, sharing their strings, and serialized
+    // and written by the thread pool.  Anything changed after the snapshot
+    // stays queued up, and is journaled against the new cache once it has
+    // been written.
+
+    const CacheEntryList entries = cacheEntries();
+    m_changedCacheItems.clear();
+    m_removedCacheItems.clear();
+
+    m_compactingGeneration = Cache::newGeneration();
+    m_cacheCompaction = QtConcurrent::run(&Cache::saveItems, entries, m_compactingGeneration);
+
+    auto watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this,
+        [this, watcher]() {
+            watcher->deleteLater();
+            completedCacheCompaction();
+
+            if(!m_changedCacheItems.isEmpty() || !m_removedCacheItems.isEmpty())
+                m_cacheSaveTimer->start();
+        });
+    watcher->setFuture(m_cacheCompaction);
+}
+
+void CollectionList::completedCacheCompaction()
+{
+    if(!m_compactingGeneration)
+        return;
+
+    // If the rewrite failed the changes in the snapshot were never saved, so
+    // make sure that the next save writes out the whole collection.
+
+    Cache::instance()->setGeneration(m_cacheCompaction.result() ? m_compactingGeneration : 0);
+    m_compactingGeneration = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private slots
+////////////////////////////////////////////////////////////////////////////////
+
+void CollectionList::slotSaveCacheChanges()
+{
+    // Picked up again once the rewrite is done.
+    if(m_cacheCompaction.isRunning())
+        return;
+
+    Cache *cache = Cache::instance();
+
+    if(cache->generation())
+        journalCacheChanges();
+
+    if(!cache->generation() || cache->journalNeedsCompaction())
+        compactCache();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CollectionListItem public methods
 ////////////////////////////////////////////////////////////////////////////////
 
 void CollectionListItem::refresh()
 {
-    int offset = CollectionList::instance()->columnOffset();
-    int columns = lastColumn() + offset + 1;
+    TrackStore *store = TrackStore::instance();
+    CollectionList *collection = CollectionList::instance();
+    const TrackStore::Id id = storeId();
 
-    sharedData()->metadata.resize(columns);
-    sharedData()->cachedWidths.resize(columns);
+    collection->beginTransaction();
+    collection->trackChanged(id);
 
-    for(int i = offset; i < columns; i++) {
-        setText(i, text(i));
-        int id = i - offset;
-        if(id != TrackNumberColumn && id != LengthColumn) {
-            // All columns other than track num and length need local-encoded data for sorting
+    // The tree view mode groups the tracks by artist, album and genre, so
+    // look at what they were before the file's tag is (re)imported.
 
-            QString toLower = text(i).toLower();
+    const TrackStore::StringId oldArtist = store->artistId(id);
+    const TrackStore::StringId oldAlbum = store->albumId(id);
+    const TrackStore::StringId oldGenre = store->genreId(id);
+    const QString oldStrings[] = { store->artist(id), store->album(id), store->genre(id) };
 
-            // For some columns, we may be able to share some strings
+    // Keep the running totals of the playlists holding this track current,
+    // rather than having them add up all of their items again.  This takes
+    // the track out of them until its new tag and widths are in.
 
-            if((id == ArtistColumn) || (id == AlbumColumn) ||
-               (id == GenreColumn)  || (id == YearColumn)  ||
-               (id == CommentColumn))
-            {
-                toLower = StringShare::tryShare(toLower);
+    QVector<Playlist *> playlists { collection };
+    for(PlaylistItem *item : as_const(m_children))
+        playlists.append(item->playlist());
 
-                if(id != YearColumn && id != CommentColumn && sharedData()->metadata[id] != toLower) {
-                    CollectionList::instance()->removeStringFromDict(sharedData()->metadata[id], id);
-                    CollectionList::instance()->addStringToDict(text(i), id);
-                }
-            }
+    for(Playlist *p : as_const(playlists))
+        p->addToTotals(id, -1);
 
-            sharedData()->metadata[id] = toLower;
-        }
+    sharedData()->fileHandle.attachToStore(id);
+    SearchIndex::instance()->update(id);
 
-        int newWidth = treeWidget()->fontMetrics().horizontalAdvance(text(i));
-        if(newWidth != sharedData()->cachedWidths[i])
-            playlist()->slotWeightDirty(i);
+    if(oldArtist != store->artistId(id)) {
+        collection->removeStringFromDict(oldStrings[0], ArtistColumn, id);
+        collection->addStringToDict(store->artist(id), ArtistColumn, id);
+    }
+    if(oldAlbum != store->albumId(id)) {
+        collection->removeStringFromDict(oldStrings[1], AlbumColumn, id);
+        collection->addStringToDict(store->album(id), AlbumColumn, id);
+    }
+    if(oldGenre != store->genreId(id)) {
+        collection->removeStringFromDict(oldStrings[2], GenreColumn, id);
+        collection->addStringToDict(store->genre(id), GenreColumn, id);
+    }
+
+    int offset = collection->columnOffset();
+    int columns = lastColumn() + offset + 1;
 
-        sharedData()->cachedWidths[i] = newWidth;
+    // Measuring every column of every track is most of the time it takes to
+    // load a large collection, and the exact widths of titles and file names
+    // don't matter much while nobody looks at the list.
+
+    const QFontMetrics metrics = treeWidget()->fontMetrics();
+    const bool estimate = !treeWidget()->isVisible();
+
+    for(int i = offset; i < columns; i++) {
+        int newWidth = textWidth(i - offset, metrics, estimate);
+        if(newWidth != store->width(id, i - offset)) {
+            for(Playlist *p : as_const(playlists))
+                p->slotWeightDirty(i - offset + p->columnOffset());
+        }
+
+        store->setWidth(id, i - offset, newWidth);
     }
 
+    for(Playlist *p : as_const(playlists))
+        p->addToTotals(id, 1);
+
+    // The text isn't stored in the items, so their views have to be told.
+    emitDataChanged();
+
     for(PlaylistItem *item : m_children) {
+        item->emitDataChanged();
         item->playlist()->update();
-        item->playlist()->playlistItemsChanged();
     }
     if(treeWidget()->isVisible())
         treeWidget()->viewport()->update();
 
-    CollectionList::instance()->playlistItemsChanged();
-    emit CollectionList::instance()->signalCollectionChanged();
+    collection->cacheItemChanged(file().absFilePath());
+    collection->commitTransaction();
 }
 
 PlaylistItem *CollectionListItem::itemForPlaylist(const Playlist *playlist)
@@ -574,14 +958,16 @@ CollectionListItem::CollectionListItem(CollectionList *parent, const FileHandle
     parent->addToDict(file.absFilePath(), this);
 
     sharedData()->fileHandle = file;
+    sharedData()->storeId = TrackStore::instance()->allocate();
 
-    if(file.tag()) {
-        refresh();
-        parent->playlistItemsChanged();
-    }
-    else {
-        qCCritical(JUK_LOG) << "CollectionListItem::CollectionListItem() -- Tag() could not be created.";
-    }
+    if(storeId() >= quint32(parent->m_trackItems.size()))
+        parent->m_trackItems.resize(storeId() + 1);
+    parent->m_trackItems[storeId()] = this;
+
+    parent->beginTransaction();
+    parent->trackAdded(storeId());
+    refresh();
+    parent->commitTransaction();
 }
 
 CollectionListItem::~CollectionListItem()
@@ -592,14 +978,28 @@ CollectionListItem::~CollectionListItem()
         delete item;
     }
 
+    TrackStore *store = TrackStore::instance();
+    const TrackStore::Id id = storeId();
+
     CollectionList *l = CollectionList::instance();
     if(l) {
+        l->beginTransaction();
+        l->trackRemoved(id);
         l->removeFromDict(file().absFilePath());
-        l->removeStringFromDict(file().tag()->album(), AlbumColumn);
-        l->removeStringFromDict(file().tag()->artist(), ArtistColumn);
-        l->removeStringFromDict(file().tag()->genre(), GenreColumn);
+        l->removeStringFromDict(store->album(id), AlbumColumn, id);
+        l->removeStringFromDict(store->artist(id), ArtistColumn, id);
+        l->removeStringFromDict(store->genre(id), GenreColumn, id);
+        l->m_trackItems[id] = nullptr;
+        l->addToTotals(id, -1);
     }
 
+    sharedData()->fileHandle.detachFromStore();
+    sharedData()->storeId = TrackStore::invalidId;
+    store->release(id);
+
+    if(l)
+        l->commitTransaction();
+
     m_collectionItem = nullptr;
 }
 
@@ -614,17 +1014,39 @@ void CollectionListItem::removeChildItem(PlaylistItem *child)
         m_children.removeAll(child);
 }
 
-bool CollectionListItem::checkCurrent()
+////////////////////////////////////////////////////////////////////////////////
+// CollectionListItem private methods
+////////////////////////////////////////////////////////////////////////////////
+
+int CollectionListItem::textWidth(int column, const QFontMetrics &metrics, bool estimate) const
 {
-    if(!file().fileInfo().exists() || !file().fileInfo().isFile())
-        return false;
+    TrackStore *store = TrackStore::instance();
+    const TrackStore::Id id = storeId();
+
+    switch(column) {
+    case ArtistColumn:
+        return store->stringWidth(store->artistId(id), metrics);
+    case AlbumColumn:
+        return store->stringWidth(store->albumId(id), metrics);
+    case GenreColumn:
+        return store->stringWidth(store->genreId(id), metrics);
+    case CommentColumn:
+        return store->stringWidth(store->commentId(id), metrics);
+    case TrackNumberColumn:
+    case YearColumn:
+    case LengthColumn:
+    case BitrateColumn:
+        return store->textWidth(storeText(id, column), metrics);
+    default:
+    {
+        const QString columnText = text(column + playlist()->columnOffset());
 
-    if(!file().current()) {
-        file().refresh();
-        refresh();
-    }
+        if(estimate)
+            return columnText.size() * metrics.averageCharWidth();
 
-    return true;
+        return metrics.horizontalAdvance(columnText);
+    }
+    }
 }
 
 // vim: set et sw=4 tw=0 sta:
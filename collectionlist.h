@@ -17,35 +17,61 @@
 #ifndef JUK_COLLECTIONLIST_H
 #define JUK_COLLECTIONLIST_H
 
+#include <QFuture>
 #include <QHash>
-#include <QVector>
 #include <QReadWriteLock>
+#include <QSet>
+#include <QVector>
 
 #include <KFileItem>
 
+#include "cache.h"
 #include "playlist.h"
 #include "playlistitem.h"
+#include "trackstore.h"
 
 class ViewMode;
 class KFileItemList;
+class QFontMetrics;
+class QTimer;
 class KDirWatch;
 
 /**
  * This type is for mapping QString track attributes like the album, artist
- * and track to an integer count representing the number of outstanding items
- * that hold the string.
+ * and track to the tracks (their TrackStore::Id) that hold the string.
  */
 
-typedef QHash<QString, int> TagCountDict;
-typedef QHashIterator<QString, int> TagCountDictIterator;
+typedef QHash<QString, QSet<TrackStore::Id>> TagTracksDict;
 
 /**
  * We then have an array of dicts, one for each column in the list view.
- * The array is sparse (not every vector will have a TagCountDict so we use
+ * The array is sparse (not every vector will have a TagTracksDict so we use
  * pointers.
  */
 
-typedef QVector<TagCountDict *> TagCountDicts;
+typedef QVector<TagTracksDict *> TagTracksDicts;
+
+/**
+ * What changed in the collection during a transaction, see
+ * CollectionList::beginTransaction().  Tracks which were added and then
+ * changed are only listed as added, and tag values which came and went again
+ * are not listed at all.  The tag values are keyed by their column.
+ */
+
+struct CollectionChanges
+{
+    QSet<TrackStore::Id> added;
+    QSet<TrackStore::Id> removed;
+    QSet<TrackStore::Id> changed;
+    QHash<int, QSet<QString>> newTags;
+    QHash<int, QSet<QString>> removedTags;
+
+    bool isEmpty() const
+    {
+        return added.isEmpty() && removed.isEmpty() && changed.isEmpty() &&
+            newTags.isEmpty() && removedTags.isEmpty();
+    }
+};
 
 /**
  * This is the "collection", or all of the music files that have been opened
@@ -78,15 +104,17 @@ protected:
     void addChildItem(PlaylistItem *child);
     void removeChildItem(PlaylistItem *child);
 
-    /**
-     * Returns true if the item is now up to date (even if this required a refresh) or
-     * false if the item is invalid.
-     */
-    bool checkCurrent();
-
     virtual CollectionListItem *collectionItem() override { return this; }
 
 private:
+    /**
+     * Returns the width of the text of \p column (not counting the column
+     * offset) in the font of \p metrics.  Texts which are different for
+     * nearly every track are only estimated from their length if \p estimate
+     * is set.
+     */
+    int textWidth(int column, const QFontMetrics &metrics, bool estimate) const;
+
     bool m_shuttingDown;
     PlaylistItemList m_children;
 };
@@ -114,20 +142,52 @@ public:
 
     CollectionListItem *lookup(const QString &file) const;
 
+    /**
+     * Returns the item of track \p id, or null if there is none.
+     */
+    CollectionListItem *itemForTrack(TrackStore::Id id) const
+    {
+        return id < quint32(m_trackItems.size()) ? m_trackItems.at(id) : nullptr;
+    }
+
+    /**
+     * Returns the tracks having each of the values of \p column, which must
+     * be the artist, album or genre column.  This is what the tree view mode
+     * playlists are made from.
+     */
+    const TagTracksDict &tagTracks(int column) const { return *m_columnTags[column]; }
+
     virtual CollectionListItem *createItem(const FileHandle &file,
                                      QTreeWidgetItem * = nullptr) override;
 
-    virtual void clearItems(const PlaylistItemList &items) override;
-
     void setupTreeViewEntries(ViewMode *viewMode) const;
 
     virtual bool canReload() const override { return true; }
 
-    void saveItemsToCache() const;
+    /**
+     * Writes any unsaved changes to the collection cache, waiting for a
+     * rewrite of the cache to finish if one is running.  Used on shutdown,
+     * otherwise changes are saved shortly after they are made.
+     */
+    void saveItemsToCache();
+
+    /**
+     * Starts gathering the changes made to the collection, which the matching
+     * commitTransaction() then announces all at once.  Transactions can be
+     * nested, in which case only the outermost one announces anything.
+     * Changes made outside of any transaction are announced right away.
+     */
+    void beginTransaction();
+    void commitTransaction();
 
 public slots:
     virtual void clear() override;
 
+    /**
+     * Checks the items loaded from the cache against the files on disk in the
+     * background, removing those that no longer exist and rereading the tags
+     * of those that were modified.
+     */
     void slotCheckCache();
 
     void slotRemoveItem(const QString &file);
@@ -143,6 +203,7 @@ protected:
 
     virtual void dropEvent(QDropEvent *e) override;
     virtual void dragMoveEvent(QDragMoveEvent *e) override;
+    virtual void changeEvent(QEvent *e) override;
 
     // These methods are used by CollectionListItem, which is a friend class.
 
@@ -151,9 +212,10 @@ protected:
 
     // These methods are also used by CollectionListItem, to manage the
     // strings used in generating the unique sets and tree view mode playlists.
+    // They have to be called within a transaction.
 
-    QString addStringToDict(const QString &value, int column);
-    void removeStringFromDict(const QString &value, int column);
+    QString addStringToDict(const QString &value, int column, TrackStore::Id track);
+    void removeStringFromDict(const QString &value, int column, TrackStore::Id track);
 
     void addWatched(const QString &file);
     void removeWatched(const QString &file);
@@ -164,14 +226,10 @@ signals:
     void signalCollectionChanged();
 
     /**
-     * This is emitted when the set of columns that is visible is changed.
-     *
-     * \see Playlist::hideColumn()
-     * \see Playlist::showColumn()
-     * \see Playlist::isColumnVisible()
+     * Emitted with everything that changed when a transaction is committed,
+     * just before signalCollectionChanged().
      */
-    void signalNewTag(const QString &, unsigned);
-    void signalRemovedTag(const QString &, unsigned);
+    void signalCollectionUpdated(const CollectionChanges &changes);
 
     // Emitted once cached items are loaded, which allows for folder scanning
     // and invalid track detection to proceed.
@@ -196,6 +254,55 @@ public slots:
      */
     void completedLoadingCachedItems();
 
+private:
+    /**
+     * What slotCheckCache() needs to know about an item to tell whether it is
+     * still current.
+     */
+    struct CachedItemState
+    {
+        QString path;
+        QDateTime baseModificationTime;
+    };
+
+    /**
+     * Items found to be missing or modified by slotCheckCache().  Refreshed
+     * items come with their tags already reread.
+     */
+    struct CachedItemChanges
+    {
+        QStringList removed;
+        FileHandleList refreshed;
+    };
+
+    /**
+     * Adds a batch of items read from the Cache, skipping any which are
+     * already in the collection.
+     */
+    void addCachedItems(const FileHandleList &files);
+
+    // Record changes for the current transaction, used by CollectionListItem.
+
+    void trackAdded(TrackStore::Id id);
+    void trackRemoved(TrackStore::Id id);
+    void trackChanged(TrackStore::Id id);
+
+    static CachedItemChanges checkCachedItems(const QVector<CachedItemState> &items);
+    void applyCachedItemChanges(const CachedItemChanges &changes);
+
+    // Bookkeeping for the collection cache, which only has the items which
+    // changed since it was last saved appended to it.
+
+    void cacheItemChanged(const QString &file);
+    void cacheItemRemoved(const QString &file);
+    CacheEntryList cacheEntries() const;
+    void journalCacheChanges();
+    void compactCache();
+    void completedCacheCompaction();
+
+private slots:
+    void slotSaveCacheChanges();
+
 private:
     /**
      * Just the size of the above enum to keep from hard coding it in several
@@ -207,7 +314,18 @@ private:
     QHash<QString, CollectionListItem *> m_itemsDict;
     mutable QReadWriteLock m_itemsDictLock;
     KDirWatch *m_dirWatch;
-    TagCountDicts m_columnTags;
+    TagTracksDicts m_columnTags;
+    QVector<CollectionListItem *> m_trackItems;
+
+    CollectionChanges m_changes;
+    int m_transactionDepth = 0;
+
+    QSet<QString> m_changedCacheItems;
+    QSet<QString> m_removedCacheItems;
+    bool m_trackCacheChanges = false;
+    QTimer *m_cacheSaveTimer;
+    QFuture<bool> m_cacheCompaction;
+    quint64 m_compactingGeneration = 0;
 };
 
 #endif
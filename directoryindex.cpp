@@ -0,0 +1,203 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "directoryindex.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include "cache.h"
+#include "juk_debug.h"
+
+const int DirectoryIndex::directoryIndexVersion = 2;
+
+// Some filesystems only keep modification times to the second (or worse), so
+// a directory changed in the same second it was listed in could look
+// unmodified afterwards.  Such directories aren't trusted.
+static const qint64 modificationTimeResolution = 2000;
+
+////////////////////////////////////////////////////////////////////////////////
+// public methods
+////////////////////////////////////////////////////////////////////////////////
+
+DirectoryIndex *DirectoryIndex::instance()
+{
+    static DirectoryIndex index;
+    return &index;
+}
+
+bool DirectoryIndex::lookup(const QString &dir, const QDateTime &modified, Entry *entry) const
+{
+    if(!modified.isValid())
+        return false;
+
+    QMutexLocker locker(&m_lock);
+
+    if(!m_valid)
+        return false;
+
+    const auto it = m_entries.constFind(dir);
+    if(it == m_entries.cend() || it->modificationTime != modified.toMSecsSinceEpoch())
+        return false;
+
+    *entry = *it;
+    return true;
+}
+
+void DirectoryIndex::insert(const QString &dir, const QDateTime &modified, Entry entry)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_lock);
+    m_dirty = true;
+
+    if(!modified.isValid() ||
+       now - modified.toMSecsSinceEpoch() < modificationTimeResolution)
+    {
+        m_entries.remove(dir);
+        return;
+    }
+
+    entry.modificationTime = modified.toMSecsSinceEpoch();
+    m_entries.insert(dir, entry);
+}
+
+void DirectoryIndex::remove(const QString &dir)
+{
+    QMutexLocker locker(&m_lock);
+
+    if(m_entries.remove(dir))
+        m_dirty = true;
+}
+
+void DirectoryIndex::setCacheGeneration(quint64 generation)
+{
+    QMutexLocker locker(&m_lock);
+
+    if(m_valid)
+        return;
+
+    m_valid = true;
+
+    if(generation && generation == m_generation)
+        return;
+
+    if(!m_entries.isEmpty()) {
+        qCDebug(JUK_LOG) << "Directory index does not belong to the music cache, dropping it";
+        m_entries.clear();
+    }
+
+    m_generation = 0;
+    m_dirty = true;
+}
+
+void DirectoryIndex::save(quint64 generation)
+{
+    QMutexLocker locker(&m_lock);
+
+    // Not checked against the cache yet, so leave the file as it is.
+    if(!m_valid || (!m_dirty && generation == m_generation))
+        return;
+
+    QSaveFile f(Cache::directoryIndexFileName());
+
+    if(!f.open(QIODevice::WriteOnly)) {
+        qCCritical(JUK_LOG) << "Error saving directory index:" << f.errorString();
+        return;
+    }
+
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_5_15);
+
+    s << qint32(directoryIndexVersion)
+      << generation
+      << quint32(m_entries.size());
+
+    for(auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+        s << it.key()
+          << it->modificationTime
+          << it->subdirectories
+          << it->playlists;
+    }
+
+    if(!f.commit()) {
+        qCCritical(JUK_LOG) << "Error saving directory index:" << f.errorString();
+    }
+    else {
+        m_generation = generation;
+        m_dirty = false;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+DirectoryIndex::DirectoryIndex()
+{
+    load();
+}
+
+void DirectoryIndex::load()
+{
+    QFile f(Cache::directoryIndexFileName());
+    if(!f.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_5_15);
+
+    qint32 version;
+    s >> version;
+
+    if(s.status() != QDataStream::Ok || version != directoryIndexVersion) {
+        qCWarning(JUK_LOG) << "Ignoring directory index version" << version;
+        return;
+    }
+
+    quint64 generation;
+    quint32 count;
+    s >> generation >> count;
+
+    if(s.status() != QDataStream::Ok)
+        return;
+
+    m_generation = generation;
+
+    m_entries.reserve(count);
+
+    for(quint32 i = 0; i < count; ++i) {
+        QString dir;
+        Entry entry;
+
+        s >> dir
+          >> entry.modificationTime
+          >> entry.subdirectories
+          >> entry.playlists;
+
+        if(s.status() != QDataStream::Ok) {
+            // Anything missing is simply listed again.
+            qCWarning(JUK_LOG) << "Directory index is truncated";
+            break;
+        }
+
+        m_entries.insert(dir, entry);
+    }
+}
+
+// vim: set et sw=4 tw=0 sta:
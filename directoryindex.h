@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_DIRECTORYINDEX_H
+#define JUK_DIRECTORYINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+
+/**
+ * Remembers what the folder scanner found in each directory it listed, along
+ * with the directory's modification time at that point.  A directory's
+ * modification time only changes when entries are added to, removed from or
+ * renamed within it, so while it stays the same there is nothing new to find
+ * there and the scanner can go straight to its subdirectories.
+ *
+ * Skipping a directory only works if its files are in the collection cache,
+ * so the index is saved along with the generation of the cache and thrown
+ * away if a different cache (or none) is loaded next time.
+ *
+ * This may be used from several loader threads at once.
+ */
+class DirectoryIndex
+{
+public:
+    struct Entry
+    {
+        qint64 modificationTime = 0; // msecs since epoch
+        QStringList subdirectories;  // names, not paths
+        QStringList playlists;       // names, not paths
+    };
+
+    static DirectoryIndex *instance();
+
+    /**
+     * Returns true and fills in \p entry if \p dir (a canonical path) has
+     * been listed before and is still unmodified as of \p modified.  This is
+     * always false until setCacheGeneration() was called.
+     */
+    bool lookup(const QString &dir, const QDateTime &modified, Entry *entry) const;
+
+    /**
+     * Records what was found when listing \p dir, which had been last
+     * modified at \p modified.
+     */
+    void insert(const QString &dir, const QDateTime &modified, Entry entry);
+
+    /**
+     * Forgets \p dir so that it is listed again on the next scan.
+     */
+    void remove(const QString &dir);
+
+    /**
+     * To be called once the collection cache of \p generation (0 if none
+     * could be loaded) has been read.  Unless the index was saved with the
+     * same cache it is cleared, so that every directory is listed again.
+     */
+    void setCacheGeneration(quint64 generation);
+
+    /**
+     * Saves the index along with the \p generation of the collection cache
+     * its directories' files were saved in.
+     */
+    void save(quint64 generation);
+
+    /**
+     * Version of the index file.
+     * 1: Not tied to a collection cache, with entry counts.
+     * 2: Current.
+     */
+    static const int directoryIndexVersion;
+
+private:
+    // private to force access through instance()
+    DirectoryIndex();
+
+    void load();
+
+private:
+    mutable QMutex m_lock;
+    QHash<QString, Entry> m_entries;
+    quint64 m_generation = 0; // of the cache the index was saved with
+    bool m_valid = false;
+    bool m_dirty = false;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -16,12 +16,22 @@
 
 #include "directoryloader.h"
 
+#include <QDirIterator>
 #include <QFileInfo>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <memory>
+#include <utility>
 
 #include "mediafiles.h"
 #include "collectionlist.h"
+#include "directoryindex.h"
+
+using std::as_const;
 
 // Classifies files into types for potential loading purposes.
 enum class MediaFileType {
@@ -34,27 +44,137 @@ enum class MediaFileType {
 static MediaFileType classifyFile(const QFileInfo &fileInfo);
 static FileHandle loadMediaFile(const QString &fileName);
 
+// Shared by the threads walking one directory tree.  Directories are taken
+// from the back of the queue, so each thread tends to go depth first and
+// stays within the part of the tree it just found.
+struct DirectoryWalk
+{
+    QMutex lock;
+    QWaitCondition changed;
+    QStringList pendingDirs;
+    QSet<QString> visitedDirs;
+    int busyWalkers = 0;    // currently listing a directory
+    int runningHelpers = 0;
+    bool finished = false;
+};
+
 DirectoryLoader::DirectoryLoader(const QString &dir, QObject *parent)
     : QObject(parent)
-    , m_dirIterator(
-        dir,
-        QDir::AllEntries | QDir::NoDotAndDotDot,
-        QDirIterator::Subdirectories | QDirIterator::FollowSymlinks)
+    , m_dir(dir)
 {
 }
 
 void DirectoryLoader::startLoading()
 {
-    static const int BATCH_SIZE = 256;
+    auto walk = std::make_shared<DirectoryWalk>();
+    walk->pendingDirs.append(m_dir);
+
+    // This thread walks as well, the helpers only join in if the thread pool
+    // has room for them.  Helpers started once the walk is over return
+    // without touching the loader, which may be gone by then.
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int helperCount = qMax(0, pool->maxThreadCount() - 1);
+
+    for(int i = 0; i < helperCount; ++i) {
+        pool->start([this, walk]() {
+            { // locked scope
+                QMutexLocker locker(&walk->lock);
+                if(walk->finished)
+                    return;
+                ++walk->runningHelpers;
+            }
+
+            walkDirectories(*walk);
+
+            QMutexLocker locker(&walk->lock);
+            --walk->runningHelpers;
+            walk->changed.wakeAll();
+        });
+    }
+
+    walkDirectories(*walk);
+
+    QMutexLocker locker(&walk->lock);
+    walk->finished = true;
+
+    while(walk->runningHelpers > 0)
+        walk->changed.wait(&walk->lock);
+}
+
+void DirectoryLoader::walkDirectories(DirectoryWalk &walk)
+{
     FileHandleList files;
+    QMutexLocker locker(&walk.lock);
+
+    while(true) {
+        // Whoever is still busy may find more directories.
+        while(walk.pendingDirs.isEmpty() && walk.busyWalkers > 0)
+            walk.changed.wait(&walk.lock);
+
+        if(walk.pendingDirs.isEmpty())
+            break;
+
+        const QString dir = walk.pendingDirs.takeLast();
+        ++walk.busyWalkers;
+        locker.unlock();
+
+        const QStringList subdirs = loadDirectory(dir, walk, files);
+
+        locker.relock();
+        walk.pendingDirs.append(subdirs);
+        --walk.busyWalkers;
+        walk.changed.wakeAll();
+    }
+
+    locker.unlock();
+
+    if(!files.isEmpty()) {
+        emit loadedFiles(files);
+    }
+}
+
+QStringList DirectoryLoader::loadDirectory(const QString &dir, DirectoryWalk &walk, FileHandleList &files)
+{
+    static const int BATCH_SIZE = 256;
 
-    while(m_dirIterator.hasNext()) {
-        const auto fileName = m_dirIterator.next();
-        const QFileInfo fileInfo(fileName);
+    const QFileInfo dirInfo(dir);
+    const QString dirPath = dirInfo.canonicalFilePath();
+
+    if(dirPath.isEmpty())
+        return QStringList();
+
+    // Symlinks are followed, so keep track of where we've been.
+    { // locked scope
+        QMutexLocker locker(&walk.lock);
+        if(walk.visitedDirs.contains(dirPath))
+            return QStringList();
+        walk.visitedDirs.insert(dirPath);
+    }
+
+    const QDateTime modified = dirInfo.lastModified();
+    DirectoryIndex::Entry entry;
+    QStringList subdirs;
+
+    if(m_index && m_index->lookup(dirPath, modified, &entry)) {
+        for(const auto &playlist : as_const(entry.playlists))
+            emit loadedPlaylist(dirPath + '/' + playlist);
+        for(const auto &subdir : as_const(entry.subdirectories))
+            subdirs.append(dirPath + '/' + subdir);
+
+        return subdirs;
+    }
+
+    QDirIterator dirIterator(dirPath, QDir::AllEntries | QDir::NoDotAndDotDot);
+
+    while(dirIterator.hasNext()) {
+        const auto fileName = dirIterator.next();
+        const QFileInfo fileInfo = dirIterator.fileInfo();
         const auto type = classifyFile(fileInfo);
 
         switch(type) {
             case MediaFileType::Playlist:
+                entry.playlists.append(fileInfo.fileName());
                 emit loadedPlaylist(fileName);
                 break;
 
@@ -71,9 +191,10 @@ void DirectoryLoader::startLoading()
                 break;
 
             case MediaFileType::Directory:
-                // this should be impossible based on the
-                // QDirIterator settings
-                continue;
+                entry.subdirectories.append(fileInfo.fileName());
+                subdirs.append(fileName);
+                break;
+
             case MediaFileType::UnusableFile:
                 continue;
             default:
@@ -81,44 +202,40 @@ void DirectoryLoader::startLoading()
         }
     }
 
-    if(!files.isEmpty()) {
-        emit loadedFiles(files);
-    }
+    if(m_index)
+        m_index->insert(dirPath, modified, entry);
+
+    return subdirs;
 }
 
 MediaFileType classifyFile(const QFileInfo &fileInfo)
 {
-    const QString path = fileInfo.canonicalFilePath();
+    if(fileInfo.isDir()) {
+        return MediaFileType::Directory;
+    }
+
+    // The type is worked out once and is usually just a lookup of the suffix,
+    // so there's no need to go back to MediaFiles for each question.
+
+    const auto type = MediaFiles::fileType(fileInfo.canonicalFilePath());
 
-    if(fileInfo.isFile() && fileInfo.isReadable() &&
-        MediaFiles::isMediaFile(path))
+    if(MediaFiles::isMediaFileType(type) &&
+        fileInfo.isFile() && fileInfo.isReadable())
     {
         return MediaFileType::MediaFile;
     }
 
-    // These are all the files we care about, anything remaining needs to be a
-    // directory or playlist or it must be unusable
-
-    if(MediaFiles::isPlaylistFile(path)) {
+    if(type == MediaFiles::FileType::Playlist) {
         return MediaFileType::Playlist;
     }
 
-    if(fileInfo.isDir()) {
-        return MediaFileType::Directory;
-    }
-
     return MediaFileType::UnusableFile;
 }
 
 FileHandle loadMediaFile(const QString &fileName)
 {
-    // Just because our GUI thread accesses are serialized by signal/slot magic
-    // doesn't mean that our non-GUI threads don't require deconfliction
-    // Neither FileHandle nor TagLib are not thread-safe so synchronize access
-    // to this function.
-    static QMutex fhLock;
-    QMutexLocker locker(&fhLock);
-
+    // Several of these may run at once, FileHandles created here aren't
+    // shared with anything until they're handed to the GUI thread.
     const auto item = CollectionList::instance()->lookup(fileName);
     if(item) {
         // Don't re-load a file if it's already loaded once
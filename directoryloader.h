@@ -18,14 +18,20 @@
 #define JUK_DIRECTORYLOADER_H
 
 #include <QObject>
-#include <QDirIterator>
+#include <QString>
+#include <QStringList>
 
 #include "filehandle.h"
 
+class DirectoryIndex;
+struct DirectoryWalk;
+
 /**
  * Loads music files and their metadata from a given directory, emitting loaded
  * files in a batch periodically. Intended for use in a separate thread as a
- * worker object.
+ * worker object.  The directory tree is split up among the threads of the
+ * global thread pool, so loadedFiles() and loadedPlaylist() can be emitted
+ * from any of them.
  */
 class DirectoryLoader : public QObject {
     Q_OBJECT
@@ -33,6 +39,14 @@ class DirectoryLoader : public QObject {
 public:
     DirectoryLoader(const QString &dir, QObject *parent = nullptr);
 
+    /**
+     * Skip listing directories that \p index says are unchanged since they
+     * were last listed, and record the ones which are listed.  Only useful
+     * when the files already found are being kept elsewhere (i.e. in the
+     * CollectionList).
+     */
+    void setDirectoryIndex(DirectoryIndex *index) { m_index = index; }
+
 public slots:
     void startLoading();
 
@@ -41,7 +55,12 @@ signals:
     void loadedPlaylist(QString fileName);
 
 private:
-    QDirIterator m_dirIterator;
+    void walkDirectories(DirectoryWalk &walk);
+    QStringList loadDirectory(const QString &dir, DirectoryWalk &walk, FileHandleList &files);
+
+private:
+    QString m_dir;
+    DirectoryIndex *m_index = nullptr;
 };
 
 #endif // JUK_DIRECTORYLOADER_H
@@ -48,11 +48,11 @@ DynamicPlaylist::DynamicPlaylist(const PlaylistList &playlists,
         m_playlists << QPointer<Playlist>(playlist);
 
         connect(&(playlist->signaller), &PlaylistInterfaceSignaller::playingItemDataChanged,
-                this, &DynamicPlaylist::slotSetDirty);
+                this, &DynamicPlaylist::slotPlaylistItemsChanged);
     }
 
-    connect(CollectionList::instance(), &CollectionList::signalCollectionChanged,
-            this, &DynamicPlaylist::slotSetDirty);
+    connect(CollectionList::instance(), &CollectionList::signalCollectionUpdated,
+            this, &DynamicPlaylist::slotCollectionUpdated);
 }
 
 DynamicPlaylist::~DynamicPlaylist()
@@ -72,6 +72,7 @@ void DynamicPlaylist::setPlaylists(const PlaylistList &playlists)
     }
 
     updateItems();
+    rememberItemsGenerations();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -148,11 +149,52 @@ void DynamicPlaylist::updateItems()
     }
 }
 
+void DynamicPlaylist::itemChanged(CollectionListItem *)
+{
+
+}
+
 bool DynamicPlaylist::synchronizePlaying() const
 {
     return m_synchronizePlaying;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// private slots
+////////////////////////////////////////////////////////////////////////////////
+
+void DynamicPlaylist::slotPlaylistItemsChanged()
+{
+    // The playlists also say so when only the tags of their items changed,
+    // which is left to itemChanged().
+
+    if(m_dirty || m_itemsGenerations.size() != m_playlists.size()) {
+        m_dirty = true;
+        return;
+    }
+
+    for(int i = 0; i < m_playlists.size(); ++i) {
+        const auto &playlist = m_playlists.at(i);
+        if(!playlist || playlist->itemsGeneration() != m_itemsGenerations.at(i)) {
+            m_dirty = true;
+            return;
+        }
+    }
+}
+
+void DynamicPlaylist::slotCollectionUpdated(const CollectionChanges &changes)
+{
+    const CollectionList *collection = CollectionList::instance();
+
+    for(const auto &ids : { changes.added, changes.changed }) {
+        for(TrackStore::Id id : ids) {
+            CollectionListItem *item = collection->itemForTrack(id);
+            if(item)
+                itemChanged(item);
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -163,8 +205,17 @@ void DynamicPlaylist::checkUpdateItems()
         return;
 
     updateItems();
+    rememberItemsGenerations();
 
     m_dirty = false;
 }
 
+void DynamicPlaylist::rememberItemsGenerations()
+{
+    m_itemsGenerations.clear();
+
+    for(const auto &playlist : as_const(m_playlists))
+        m_itemsGenerations.append(playlist ? playlist->itemsGeneration() : 0);
+}
+
 // vim: set et sw=4 tw=0 sta:
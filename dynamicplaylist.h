@@ -23,6 +23,7 @@
 #include <QPointer>
 
 class PlaylistDirtyObserver;
+struct CollectionChanges;
 
 using GuardedPlaylist = QPointer<Playlist>;
 
@@ -96,8 +97,30 @@ protected:
      */
     virtual void updateItems();
 
+    /**
+     * Called when \p item was added to the collection or its tag changed,
+     * once per transaction of the collection.  That doesn't change the items
+     * of a plain dynamic playlist (and the items show the new tag on their
+     * own) so this does nothing, subclasses whose items depend on the tags
+     * should add or remove \p item as needed.
+     */
+    virtual void itemChanged(CollectionListItem *item);
+
     bool synchronizePlaying() const;
 
+private slots:
+    /**
+     * Marks the list as dirty if items were added to or removed from one of
+     * the playlists it is made from.
+     */
+    void slotPlaylistItemsChanged();
+
+    /**
+     * Calls itemChanged() for the tracks which were added to or changed in
+     * the collection.
+     */
+    void slotCollectionUpdated(const CollectionChanges &changes);
+
 private:
     /**
      * Checks to see if the current list of items is "dirty" and if so updates
@@ -106,9 +129,12 @@ private:
      */
     void checkUpdateItems();
 
+    void rememberItemsGenerations();
+
 private:
     PlaylistItemList m_siblings;
     QVector<GuardedPlaylist> m_playlists;
+    QVector<quint32> m_itemsGenerations;
     bool m_dirty;
     bool m_synchronizePlaying;
 };
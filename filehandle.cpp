@@ -46,18 +46,37 @@ public:
     FileHandlePrivate(QFileInfo fInfo)
         : tag(nullptr)
         , coverInfo(nullptr)
-        , fileInfo(fInfo)
+        , fileInfo(new QFileInfo(fInfo))
         , absFilePath(fInfo.canonicalFilePath())
+        , storeId(TrackStore::invalidId)
     {
-        baseModificationTime = fileInfo.lastModified();
+        baseModificationTime = fileInfo->lastModified();
+    }
+
+    FileHandlePrivate(const QString &canonicalPath, Tag *cachedTag, const QDateTime &modified)
+        : tag(cachedTag)
+        , coverInfo(nullptr)
+        , absFilePath(canonicalPath)
+        , baseModificationTime(modified)
+        , storeId(TrackStore::invalidId)
+    {
+    }
+
+    // Files restored from the cache only get a QFileInfo when one is needed.
+    const QFileInfo &info() const
+    {
+        if(!fileInfo)
+            fileInfo.reset(new QFileInfo(absFilePath));
+        return *fileInfo;
     }
 
     mutable QScopedPointer<Tag> tag;
     mutable QScopedPointer<CoverInfo> coverInfo;
-    QFileInfo fileInfo;
+    mutable QScopedPointer<QFileInfo> fileInfo;
     QString absFilePath;
     QDateTime baseModificationTime;
     mutable QDateTime lastModified;
+    TrackStore::Id storeId;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -87,16 +106,25 @@ FileHandle::FileHandle(const QString &path)
 FileHandle::FileHandle(const QString &path, CacheDataStream &s)
     : FileHandle(QFileInfo(path)) // delegating ctor
 {
-    if(d->fileInfo.exists())
+    if(d->info().exists())
         read(s);
 }
 
+FileHandle::FileHandle(const QString &path, Tag *tag, const QDateTime &lastModified)
+    : d(new FileHandlePrivate(path, tag, lastModified))
+{
+}
+
 FileHandle::~FileHandle() = default;
 
 void FileHandle::refresh()
 {
-    d->fileInfo.refresh();
+    if(d->fileInfo)
+        d->fileInfo->refresh();
     d->tag.reset(new Tag(d->absFilePath));
+
+    d->baseModificationTime = d->info().lastModified();
+    d->lastModified = QDateTime();
 }
 
 void FileHandle::setFile(const QString &path)
@@ -111,18 +139,62 @@ void FileHandle::setFile(const QString &path)
         return;
     }
 
+    // Copies of this handle keep the old data, which must not keep reading a
+    // row of the store that is going to be reused.
+    detachFromStore();
+
     d = new FileHandlePrivate(QFileInfo(path));
 }
 
 Tag *FileHandle::tag() const
 {
     if(Q_UNLIKELY(!d->tag)) {
-        d->tag.reset(new Tag(d->absFilePath));
+        if(d->storeId != TrackStore::invalidId)
+            d->tag.reset(new Tag(TrackStore::instance()->tag(d->storeId, d->absFilePath)));
+        else
+            d->tag.reset(new Tag(d->absFilePath));
     }
 
     return d->tag.data();
 }
 
+Tag FileHandle::tagSnapshot() const
+{
+    if(d->storeId != TrackStore::invalidId && !d->tag)
+        return TrackStore::instance()->tag(d->storeId, d->absFilePath);
+
+    return *tag();
+}
+
+void FileHandle::attachToStore(TrackStore::Id id)
+{
+    // A tag built since the last time is newer than what's in the store.
+    if(d->storeId == id && !d->tag)
+        return;
+
+    TrackStore::instance()->setTag(id, *tag());
+
+    d->storeId = id;
+    d->tag.reset();
+}
+
+void FileHandle::detachFromStore()
+{
+    if(d->storeId == TrackStore::invalidId)
+        return;
+
+    // Only worth keeping a Tag if someone else still holds on to the file.
+    if(!d->tag && d->ref.loadRelaxed() > 1)
+        d->tag.reset(new Tag(TrackStore::instance()->tag(d->storeId, d->absFilePath)));
+
+    d->storeId = TrackStore::invalidId;
+}
+
+TrackStore::Id FileHandle::storeId() const
+{
+    return d->storeId;
+}
+
 CoverInfo *FileHandle::coverInfo() const
 {
     if(Q_UNLIKELY(!d->coverInfo))
@@ -138,7 +210,7 @@ QString FileHandle::absFilePath() const
 
 const QFileInfo &FileHandle::fileInfo() const
 {
-    return d->fileInfo;
+    return d->info();
 }
 
 bool FileHandle::isNull() const
@@ -156,11 +228,16 @@ bool FileHandle::current() const
 const QDateTime &FileHandle::lastModified() const
 {
     if(d->lastModified.isNull())
-        d->lastModified = d->fileInfo.lastModified();
+        d->lastModified = d->info().lastModified();
 
     return d->lastModified;
 }
 
+const QDateTime &FileHandle::baseModificationTime() const
+{
+    return d->baseModificationTime;
+}
+
 void FileHandle::read(CacheDataStream &s)
 {
     switch(s.cacheVersion()) {
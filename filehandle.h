@@ -22,6 +22,8 @@
 #include <QMetaType>
 #include <QStringList>
 
+#include "trackstore.h"
+
 class QString;
 class QFileInfo;
 class QDateTime;
@@ -45,6 +47,13 @@ public:
     explicit FileHandle(const QString &path);
     FileHandle(const QString &path, CacheDataStream &s);
 
+    /**
+     * Used by the Cache to restore a file whose tag has already been read.
+     * \p path must already be canonical, the file is not touched on disk and
+     * the FileHandle takes ownership of \p tag.
+     */
+    FileHandle(const QString &path, Tag *tag, const QDateTime &lastModified);
+
     // manually declared so its definition can be delayed until .cpp
     ~FileHandle();
 
@@ -55,6 +64,33 @@ public:
     void setFile(const QString &path);
 
     Tag *tag() const;
+
+    /**
+     * Returns a copy of the tag.  Unlike tag() this does not keep a Tag alive
+     * for files whose metadata lives in the TrackStore.
+     */
+    Tag tagSnapshot() const;
+
+    /**
+     * Moves the metadata of the file into row \p id of the TrackStore.  A Tag
+     * is only built again if tag() is called, and that one (or the one reread
+     * by refresh()) is taken by the next call.  This must be done from the GUI
+     * thread.
+     */
+    void attachToStore(TrackStore::Id id);
+
+    /**
+     * Takes the metadata back out of the TrackStore, for when its row is
+     * about to be released.
+     */
+    void detachFromStore();
+
+    /**
+     * Returns the TrackStore row the file is attached to, or
+     * TrackStore::invalidId.
+     */
+    TrackStore::Id storeId() const;
+
     CoverInfo *coverInfo() const;
     QString absFilePath() const;
     const QFileInfo &fileInfo() const;
@@ -63,6 +99,12 @@ public:
     bool current() const;
     const QDateTime &lastModified() const;
 
+    /**
+     * Returns the modification time of the file as of when its tag was read.
+     * Unlike lastModified() this never has to go to the disk.
+     */
+    const QDateTime &baseModificationTime() const;
+
     void read(CacheDataStream &s);
 
     FileHandle &operator=(const FileHandle &f);
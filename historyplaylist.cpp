@@ -91,6 +91,13 @@ HistoryPlaylistItem::HistoryPlaylistItem(CollectionListItem *item, Playlist *par
     setText(0, m_dateTime.toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
 }
 
+HistoryPlaylistItem::HistoryPlaylistItem(CollectionListItem *item) :
+    PlaylistItem(item),
+    m_dateTime(QDateTime::currentDateTime())
+{
+    setText(0, m_dateTime.toString(QStringLiteral("yyyy-MM-dd HH:mm:ss")));
+}
+
 void HistoryPlaylistItem::setDateTime(const QDateTime &dt)
 {
     m_dateTime = dt;
@@ -26,6 +26,7 @@ class HistoryPlaylistItem : public PlaylistItem
 {
 public:
     HistoryPlaylistItem(CollectionListItem *item, Playlist *parent, QTreeWidgetItem *after = nullptr);
+    explicit HistoryPlaylistItem(CollectionListItem *item);
 
     QDateTime dateTime() const { return m_dateTime; }
     void setDateTime(const QDateTime &dt);
@@ -50,6 +50,7 @@
 #include "filerenamerconfigdlg.h"
 #include "iconsupport.h"
 #include "keydialog.h"
+#include "mediafiles.h"
 #include "playermanager.h"
 #include "playlistsplitter.h"
 #include "scrobbleconfigdlg.h"
@@ -93,6 +94,7 @@ JuK::JuK(const QStringList &filesToOpen, QWidget *parent)
     m_instance = this;
 
     Cache::ensureAppDataStorageExists();
+    MediaFiles::initializeTagLib();
 
     setupActions();
     setupLayout(); // Creates PlaylistSplitter and therefore CollectionList
@@ -542,6 +544,10 @@ void JuK::slotQuit()
 
     saveConfig();
 
+    // Saving the collection may have to wait for the cache writer to finish,
+    // don't leave a frozen window on screen while it does.
+    hide();
+
     // this will start chain of events causing PlaylistCollection (in
     // guise of PlaylistBox) and CollectionList (as first Playlist child)
     // to save themselves and then quit the application when this widget
@@ -25,7 +25,6 @@
 #include <tag.h>
 #include <tfile.h>
 #include <audioproperties.h>
-#include <id3v2framefactory.h>
 
 #include "cache.h"
 #include "mediafiles.h"
@@ -45,6 +44,10 @@ Tag::Tag(const QString &fileName)
         return;
     }
 
+    // Tags are read by several loader threads at once.  That's fine as long as
+    // everything used from here (TagLib, MediaFiles and StringShare) only
+    // touches state that is either local to this Tag or thread-safe.
+
     auto file = QScopedPointer<TagLib::File>(MediaFiles::fileFactoryByType(fileName));
     if(file && file->isValid()) {
         setup(file.get());
@@ -58,7 +61,6 @@ Tag::Tag(const QString &fileName)
 bool Tag::save() const
 {
     bool result;
-    TagLib::ID3v2::FrameFactory::instance()->setDefaultTextEncoding(TagLib::String::UTF8);
 
     auto file = QScopedPointer<TagLib::File>(MediaFiles::fileFactoryByType(m_fileName));
 
@@ -32,6 +32,8 @@ class CacheDataStream;
 class Tag
 {
     friend class FileHandle;
+    friend class Cache;
+    friend class TrackStore;
 public:
     Tag(const QString &fileName);
     /**
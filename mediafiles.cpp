@@ -27,10 +27,13 @@
 #include <QStandardPaths>
 #include <QMimeType>
 #include <QMimeDatabase>
+#include <QHash>
+#include <QReadWriteLock>
 
 #include <taglib.h>
 #include <tag.h>
 #include <tdebuglistener.h>
+#include <id3v2framefactory.h>
 #include <mpegfile.h>
 #include <vorbisfile.h>
 #include <flacfile.h>
@@ -63,20 +66,22 @@ struct TaglibDebugHook final : public TagLib::DebugListener
         qCDebug(JUK_LOG) << m_filename << TStringToQString(msg);
     }
 
+    // Files are opened from several threads at once, TagLib calls us back
+    // on the thread that is reading the file.
     void setCurrentFile(const QString &filename)
     {
         m_filename = filename;
     }
 
 private:
-    QString m_filename;
+    static thread_local QString m_filename;
 };
 
+thread_local QString TaglibDebugHook::m_filename;
+
 Q_GLOBAL_STATIC(TaglibDebugHook, debugHook);
 
 namespace MediaFiles {
-    static QStringList savedMimeTypes;
-
     static const char mp3Type[]  = "audio/mpeg";
     static const char oggType[]  = "audio/ogg";
     static const char flacType[] = "audio/x-flac";
@@ -149,118 +154,187 @@ QString MediaFiles::savePlaylistDialog(const QString &playlistName, QWidget *par
     return fileName;
 }
 
-TagLib::File *MediaFiles::fileFactoryByType(const QString &fileName)
+// Resolves a MIME type against the types we support.  The most specific types
+// have to be checked first as some inherit others (e.g. Opus is Ogg).
+static MediaFiles::FileType fileTypeForMimeType(const QMimeType &mimeType, const QString &suffix)
 {
-    QMimeDatabase db;
-    QMimeType result = db.mimeTypeForFile(fileName);
-    if(!result.isValid())
-        return nullptr;
-
-    TagLib::File *file(nullptr);
-    debugHook->setCurrentFile(fileName);
-    QByteArray encodedFileName(QFile::encodeName(fileName));
-
-    if(result.inherits(QLatin1String(mp3Type)))
-        file = new TagLib::MPEG::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(flacType)))
-        file = new TagLib::FLAC::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(vorbisType)))
-        file = new TagLib::Vorbis::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(asfType)))
-        file = new TagLib::ASF::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(mp4Type)) || result.inherits(QLatin1String(mp4AudiobookType)))
-        file = new TagLib::MP4::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(mpcType)))
-        file = new TagLib::MPC::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(oggflacType)))
-        file = new TagLib::Ogg::FLAC::File(encodedFileName.constData());
-    else if(result.inherits(QLatin1String(oggopusType)) ||
-            (result.inherits(QLatin1String(oggType)) && fileName.endsWith(QLatin1String(".opus")))
-            )
+    using namespace MediaFiles;
+
+    if(!mimeType.isValid())
+        return FileType::Unsupported;
+
+    if(mimeType.inherits(QLatin1String(mp3Type)))
+        return FileType::MP3;
+    if(mimeType.inherits(QLatin1String(flacType)))
+        return FileType::FLAC;
+    if(mimeType.inherits(QLatin1String(vorbisType)))
+        return FileType::Vorbis;
+    if(mimeType.inherits(QLatin1String(asfType)))
+        return FileType::ASF;
+    if(mimeType.inherits(QLatin1String(mp4Type)) || mimeType.inherits(QLatin1String(mp4AudiobookType)))
+        return FileType::MP4;
+    if(mimeType.inherits(QLatin1String(mpcType)))
+        return FileType::MPC;
+    if(mimeType.inherits(QLatin1String(oggflacType)))
+        return FileType::OggFLAC;
+    if(mimeType.inherits(QLatin1String(oggopusType)) ||
+       (mimeType.inherits(QLatin1String(oggType)) &&
+        suffix.compare(QLatin1String("opus"), Qt::CaseInsensitive) == 0))
     {
-        file = new TagLib::Ogg::Opus::File(encodedFileName.constData());
+        return FileType::Opus;
     }
+    if(mimeType.inherits(QLatin1String(oggType)))
+        return FileType::Ogg;
+    if(mimeType.inherits(QLatin1String(m3uType)))
+        return FileType::Playlist;
 
-    return file;
+    return FileType::Unsupported;
 }
 
-bool MediaFiles::isMediaFile(const QString &fileName)
+MediaFiles::FileType MediaFiles::fileType(const QString &fileName)
 {
-    QMimeDatabase db;
-    QMimeType result = db.mimeTypeForFile(fileName);
-    if(!result.isValid())
-        return false;
-
-    // Search through our table of media types for a match
-    const auto validMimeTypes(mimeTypes());
-    for(const auto &mimeType : validMimeTypes) {
-        if(result.inherits(mimeType))
-            return true;
+    static QReadWriteLock suffixTypesLock;
+    static QHash<QString, FileType> suffixTypes;
+
+    const int lastSlash = fileName.lastIndexOf(QLatin1Char('/'));
+    const int lastDot = fileName.lastIndexOf(QLatin1Char('.'));
+    const QString suffix = lastDot > lastSlash + 1
+        ? fileName.mid(lastDot + 1).toLower()
+        : QString();
+
+    if(!suffix.isEmpty()) {
+        { // locked scope
+            QReadLocker locker(&suffixTypesLock);
+
+            const auto it = suffixTypes.constFind(suffix);
+            if(it != suffixTypes.cend())
+                return *it;
+        }
+
+        // Only a suffix matching exactly one type can stand in for every
+        // file that has it.
+
+        QMimeDatabase db;
+        const auto mimeTypes = db.mimeTypesForFileName(QLatin1String("file.") + suffix);
+
+        if(mimeTypes.count() == 1) {
+            const FileType type = fileTypeForMimeType(mimeTypes.first(), suffix);
+
+            QWriteLocker locker(&suffixTypesLock);
+            suffixTypes.insert(suffix, type);
+            return type;
+        }
     }
 
-    return false;
+    QMimeDatabase db;
+    return fileTypeForMimeType(db.mimeTypeForFile(fileName), suffix);
 }
 
-static bool isFileOfMimeType(const QString &fileName, const QString &mimeType)
+void MediaFiles::initializeTagLib()
 {
-    QMimeDatabase db;
-    QMimeType result = db.mimeTypeForFile(fileName);
-    return result.isValid() && result.inherits(mimeType);
+    // Both of these are process-wide, so they have to be in place before the
+    // first thread starts reading tags.
+    (void) debugHook();
+    TagLib::ID3v2::FrameFactory::instance()->setDefaultTextEncoding(TagLib::String::UTF8);
+}
+
+TagLib::File *MediaFiles::fileFactoryByType(const QString &fileName)
+{
+    return fileFactoryByType(fileName, fileType(fileName));
+}
+
+TagLib::File *MediaFiles::fileFactoryByType(const QString &fileName, FileType type)
+{
+    if(!isMediaFileType(type))
+        return nullptr;
+
+    debugHook->setCurrentFile(fileName);
+    QByteArray encodedFileName(QFile::encodeName(fileName));
+
+    switch(type) {
+    case FileType::MP3:
+        return new TagLib::MPEG::File(encodedFileName.constData());
+    case FileType::FLAC:
+        return new TagLib::FLAC::File(encodedFileName.constData());
+    case FileType::Vorbis:
+        return new TagLib::Vorbis::File(encodedFileName.constData());
+    case FileType::ASF:
+        return new TagLib::ASF::File(encodedFileName.constData());
+    case FileType::MP4:
+        return new TagLib::MP4::File(encodedFileName.constData());
+    case FileType::MPC:
+        return new TagLib::MPC::File(encodedFileName.constData());
+    case FileType::OggFLAC:
+        return new TagLib::Ogg::FLAC::File(encodedFileName.constData());
+    case FileType::Opus:
+        return new TagLib::Ogg::Opus::File(encodedFileName.constData());
+    default:
+        return nullptr;
+    }
+}
+
+bool MediaFiles::isMediaFile(const QString &fileName)
+{
+    return isMediaFileType(fileType(fileName));
 }
 
 bool MediaFiles::isPlaylistFile(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, m3uType);
+    return fileType(fileName) == FileType::Playlist;
 }
 
 bool MediaFiles::isMP3(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, mp3Type);
+    return fileType(fileName) == FileType::MP3;
 }
 
 bool MediaFiles::isOgg(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, oggType);
+    const FileType type = fileType(fileName);
+    return type == FileType::Vorbis || type == FileType::OggFLAC ||
+           type == FileType::Opus || type == FileType::Ogg;
 }
 
 bool MediaFiles::isFLAC(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, flacType);
+    return fileType(fileName) == FileType::FLAC;
 }
 
 bool MediaFiles::isMPC(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, mpcType);
+    return fileType(fileName) == FileType::MPC;
 }
 
 bool MediaFiles::isVorbis(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, vorbisType);
+    return fileType(fileName) == FileType::Vorbis;
 }
 
 bool MediaFiles::isASF(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, asfType);
+    return fileType(fileName) == FileType::ASF;
 }
 
 bool MediaFiles::isMP4(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, mp4Type) || isFileOfMimeType(fileName, mp4AudiobookType);
+    return fileType(fileName) == FileType::MP4;
 }
 
 bool MediaFiles::isOggFLAC(const QString &fileName)
 {
-    return isFileOfMimeType(fileName, oggflacType);
+    return fileType(fileName) == FileType::OggFLAC;
 }
 
 QStringList MediaFiles::mimeTypes()
 {
-    if(!savedMimeTypes.isEmpty())
-        return savedMimeTypes;
-
-    for(unsigned i = 0; i < ARRAY_SIZE(mediaTypes); ++i) {
-        savedMimeTypes << QLatin1String(mediaTypes[i]);
-    }
+    // Built only once, in a thread-safe manner, as the loader threads need it.
+    static const QStringList savedMimeTypes = [] {
+        QStringList types;
+        for(unsigned i = 0; i < ARRAY_SIZE(mediaTypes); ++i) {
+            types << QLatin1String(mediaTypes[i]);
+        }
+        return types;
+    }();
 
     return savedMimeTypes;
 }
@@ -34,6 +34,40 @@ namespace TagLib {
  */
 namespace MediaFiles
 {
+    /**
+     * The kinds of files JuK knows how to handle, as far as their names (or
+     * contents, failing that) tell.
+     */
+    enum class FileType {
+        Unsupported,
+        MP3,
+        FLAC,
+        Vorbis,
+        ASF,
+        MP4,
+        MPC,
+        OggFLAC,
+        Opus,
+        Ogg,      // some other Ogg stream, playable but without tag support
+        Playlist
+    };
+
+    /**
+     * Returns the type of fileName.  The MIME type is only looked up once for
+     * each file name suffix and remembered, only files with a suffix that
+     * doesn't tell have their contents inspected.  This may be called from
+     * any thread.
+     */
+    FileType fileType(const QString &fileName);
+
+    /**
+     * Returns true if \p type is a supported media file type.
+     */
+    inline bool isMediaFileType(FileType type)
+    {
+        return type != FileType::Unsupported && type != FileType::Playlist;
+    }
+
     /**
      * Returns a list of selected music files to open, or an empty list if
      * canceled.
@@ -46,6 +80,13 @@ namespace MediaFiles
      */
     QString savePlaylistDialog(const QString &playlistName, QWidget *parent = nullptr);
 
+    /**
+     * Sets up TagLib's process-wide state (the debug listener and the default
+     * ID3v2 text encoding).  This must be called once from the GUI thread
+     * before any file is read.
+     */
+    void initializeTagLib();
+
     /**
      * Returns a pointer to a new appropriate subclass of TagLib::File, or
      * a null pointer if there is no appropriate subclass for the given
@@ -53,6 +94,11 @@ namespace MediaFiles
      */
     TagLib::File *fileFactoryByType(const QString &fileName);
 
+    /**
+     * As above, for a file already known to be of the given \p type.
+     */
+    TagLib::File *fileFactoryByType(const QString &fileName, FileType type);
+
     /**
      * Returns true if fileName is a supported media file.
      */
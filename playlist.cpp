@@ -40,9 +40,11 @@
 #include <QDropEvent>
 #include <QFile>
 #include <QFileDialog>
+#include <QHash>
 #include <QHeaderView>
 #include <QKeyEvent>
 #include <QList>
+#include <QMap>
 #include <QMenu>
 #include <QMimeData>
 #include <QMouseEvent>
@@ -52,6 +54,7 @@
 #include <QSet>
 #include <QStackedWidget>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QTimer>
 
 #include <QtConcurrent>
@@ -62,6 +65,7 @@
 #include <time.h>
 #include <cmath>
 #include <algorithm>
+#include <numeric>
 #include <random>
 #include <utility>
 
@@ -70,6 +74,7 @@
 #include "collectionlist.h"
 #include "coverinfo.h"
 #include "deletedialog.h"
+#include "directoryindex.h"
 #include "directoryloader.h"
 #include "filerenamer.h"
 #include "iconsupport.h"
@@ -81,6 +86,7 @@
 #include "playlistsearch.h"
 #include "playlistsharedsettings.h"
 #include "tagtransactionmanager.h"
+#include "trackstore.h"
 #include "upcomingplaylist.h"
 
 using namespace ActionCollection; // ""_act and others
@@ -101,6 +107,59 @@ static bool manualResize()
     return "resizeColumnsManually"_act->isChecked();
 }
 
+/**
+ * Below this many items QTreeWidget's own sort is quick enough.
+ */
+static const int concurrentSortSize = 20000;
+
+/**
+ * A std::stable_sort() spread over the global thread pool.  Each thread sorts
+ * a run of its own, then neighbouring runs are merged in pairs (again in
+ * parallel) until only one is left.
+ */
+template<typename T, typename LessThan>
+static void concurrentStableSort(QVector<T> &items, LessThan lessThan)
+{
+    const int runCount = qMin(QThreadPool::globalInstance()->maxThreadCount(),
+                              int(items.size() / 1024));
+
+    if(runCount < 2) {
+        std::stable_sort(items.begin(), items.end(), lessThan);
+        return;
+    }
+
+    T *data = items.data();
+
+    QVector<int> bounds;
+    for(int i = 0; i <= runCount; ++i)
+        bounds.append(int(qint64(items.size()) * i / runCount));
+
+    QVector<int> runs(runCount);
+    std::iota(runs.begin(), runs.end(), 0);
+
+    QtConcurrent::blockingMap(runs, [data, &bounds, lessThan](int &run) {
+        std::stable_sort(data + bounds[run], data + bounds[run + 1], lessThan);
+    });
+
+    while(bounds.size() > 2) {
+        QVector<int> merges;
+        for(int i = 0; i + 2 < bounds.size(); i += 2)
+            merges.append(i);
+
+        QtConcurrent::blockingMap(merges, [data, &bounds, lessThan](int &i) {
+            std::inplace_merge(data + bounds[i], data + bounds[i + 1], data + bounds[i + 2], lessThan);
+        });
+
+        QVector<int> merged;
+        for(int i = 0; i < bounds.size(); i += 2)
+            merged.append(bounds[i]);
+        if(merged.last() != bounds.last())
+            merged.append(bounds.last());
+
+        bounds = merged;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // static members
 ////////////////////////////////////////////////////////////////////////////////
@@ -222,10 +281,11 @@ void Playlist::playNextAlbum()
         return;
     }
 
-    const auto currentAlbum = item->file().tag()->album();
+    const TrackStore *store = TrackStore::instance();
+    const auto currentAlbum = store->albumId(item->storeId());
     const auto nextAlbumTrack = std::find_if(m_randomSequence.begin(), m_randomSequence.end(),
-            [currentAlbum](const PlaylistItem *item) {
-                return item->file().tag()->album() != currentAlbum;
+            [store, currentAlbum](const PlaylistItem *item) {
+                return store->albumId(item->storeId()) != currentAlbum;
             });
 
     if(nextAlbumTrack == m_randomSequence.end()) {
@@ -366,7 +426,15 @@ void Playlist::saveAs()
 
 void Playlist::updateDeletedItem(PlaylistItem *item)
 {
-    m_members.remove(item->file().absFilePath());
+    ++m_itemsGeneration;
+
+    // A CollectionListItem has already released its row by the time its
+    // ~PlaylistItem() gets here, and takes itself out of the totals itself.
+
+    if(item->storeId() != TrackStore::invalidId)
+        addToTotals(item->storeId(), -1);
+
+    m_members.remove(item->storeId());
     m_randomSequence.removeAll(item);
     m_history.removeAll(item);
 }
@@ -381,9 +449,65 @@ void Playlist::clearItem(PlaylistItem *item)
 
 void Playlist::clearItems(const PlaylistItemList &items)
 {
-    for(auto &item : items) {
-        delete item;
+    // Deleting the items one at a time has Qt look up and announce each row
+    // and has updateDeletedItem() scan the random sequence and history for
+    // each of them, which is quadratic for large playlists.  Do that
+    // bookkeeping in one pass and take the items out of the tree before
+    // deleting them, which ~PlaylistItem() then leaves alone.
+
+    if(items.isEmpty()) {
+        playlistItemsChanged();
+        return;
+    }
+
+    // Items of other playlists are left to ~PlaylistItem(), as before.
+
+    QSet<PlaylistItem *> removed;
+    removed.reserve(items.size());
+    for(PlaylistItem *item : items) {
+        if(item->playlist() == this)
+            removed.insert(item);
+    }
+
+    ++m_itemsGeneration;
+
+    for(PlaylistItem *item : removed) {
+        if(item->collectionItem() != item)
+            addToTotals(item->storeId(), -1);
+        m_members.remove(item->storeId());
+        emit signalAboutToRemove(item);
+    }
+
+    const auto isRemoved = [&removed](PlaylistItem *item) {
+        return removed.contains(item);
+    };
+
+    m_randomSequence.erase(
+        std::remove_if(m_randomSequence.begin(), m_randomSequence.end(), isRemoved),
+        m_randomSequence.end());
+    m_history.erase(
+        std::remove_if(m_history.begin(), m_history.end(), isRemoved),
+        m_history.end());
+
+    if(removed.size() == topLevelItemCount()) {
+        invisibleRootItem()->takeChildren();
+    }
+    else {
+        // Going backwards keeps the rows ahead of the next one stable and
+        // makes the removals cheap for Qt.
+
+        for(int i = topLevelItemCount() - 1; i >= 0; --i) {
+            if(removed.contains(static_cast<PlaylistItem *>(topLevelItem(i))))
+                takeTopLevelItem(i);
+        }
+    }
+
+    for(PlaylistItem *item : std::as_const(items)) {
+        if(!removed.contains(item))
+            delete item;
     }
+    qDeleteAll(removed);
+
     playlistItemsChanged();
 }
 
@@ -444,13 +568,19 @@ void Playlist::setItemsVisible(const QModelIndexList &indexes, bool visible) //
 
 void Playlist::setSearch(PlaylistSearch* s)
 {
+    if(s != m_search)
+        s->narrowFrom(m_search);
+
     m_search = s;
 
     if(!m_searchEnabled)
         return;
 
-    for(int row = 0; row < topLevelItemCount(); ++row)
-        topLevelItem(row)->setHidden(true);
+    for(int row = 0; row < topLevelItemCount(); ++row) {
+        QTreeWidgetItem *item = topLevelItem(row);
+        if(!item->isHidden())
+            item->setHidden(true);
+    }
     setItemsVisible(s->matchedItems(), true);
 
     refillRandomList();
@@ -680,9 +810,11 @@ void Playlist::refillRandomList()
     std::shuffle(randomItems.begin(), randomItems.end(), knuth_lcg);
 
     if(action("albumRandomPlay")->isChecked()) {
+        const TrackStore *store = TrackStore::instance();
         std::sort(randomItems.begin(), randomItems.end(),
-            [](PlaylistItem *a, PlaylistItem *b) {
-                return a->file().tag()->album() < b->file().tag()->album();
+            [store](PlaylistItem *a, PlaylistItem *b) {
+                return store->albumId(a->storeId()) != store->albumId(b->storeId()) &&
+                    store->album(a->storeId()) < store->album(b->storeId());
             });
 
         // If there is an item playing from our playlist already, move its
@@ -690,10 +822,10 @@ void Playlist::refillRandomList()
 
         const auto wasPlaying = playingItem();
         if(wasPlaying && wasPlaying->playlist() == this) {
-            const auto playingAlbum = wasPlaying->file().tag()->album();
+            const auto playingAlbum = store->albumId(wasPlaying->storeId());
             std::stable_partition(randomItems.begin(), randomItems.end(),
-                [playingAlbum](const PlaylistItem *item) {
-                    return item->file().tag()->album() == playingAlbum;
+                [store, playingAlbum](const PlaylistItem *item) {
+                    return store->albumId(item->storeId()) == playingAlbum;
                 });
         }
     }
@@ -812,10 +944,80 @@ void Playlist::removeFromDisk(const PlaylistItemList &items)
 
 void Playlist::synchronizeItemsTo(const PlaylistItemList &itemList)
 {
-    // direct call to ::items to avoid infinite loop, bug 402355
     m_randomSequence.clear();
-    clearItems(Playlist::items());
-    createItems(itemList);
+
+    // Only touch the items which come or go, rebuilding every item of a large
+    // playlist whenever one of them changed is slow and loses the selection.
+
+    QSet<CollectionListItem *> wanted;
+    wanted.reserve(itemList.size());
+    for(PlaylistItem *item : itemList)
+        wanted.insert(item->collectionItem());
+
+    QHash<CollectionListItem *, PlaylistItem *> kept;
+    PlaylistItemList removed;
+
+    // direct call to ::items to avoid infinite loop, bug 402355
+    const PlaylistItemList current = Playlist::items();
+    for(PlaylistItem *item : current) {
+        CollectionListItem *collectionItem = item->collectionItem();
+        if(wanted.contains(collectionItem) && !kept.contains(collectionItem))
+            kept.insert(collectionItem, item);
+        else
+            removed.append(item);
+    }
+
+    if(!removed.isEmpty())
+        clearItems(removed);
+
+    // New items go in after the kept item preceding them in itemList.  Only
+    // kept items are left in the tree now, so remember their rows, gather the
+    // new items by the row they follow and insert from the bottom up so that
+    // the rows still to come don't move.
+
+    QHash<PlaylistItem *, int> keptRows;
+    keptRows.reserve(topLevelItemCount());
+    for(int row = 0; row < topLevelItemCount(); ++row)
+        keptRows.insert(static_cast<PlaylistItem *>(topLevelItem(row)), row);
+
+    QMap<int, QList<QTreeWidgetItem *>> newItems;
+    int row = 0;
+
+    for(PlaylistItem *item : itemList) {
+        CollectionListItem *collectionItem = item->collectionItem();
+        const auto existing = kept.constFind(collectionItem);
+
+        if(existing == kept.constEnd()) {
+            kept.insert(collectionItem, nullptr);
+            insertMember(collectionItem);
+            newItems[row].append(new PlaylistItem(collectionItem));
+        }
+        else if(existing.value())
+            row = keptRows.value(existing.value()) + 1;
+    }
+
+    if(newItems.isEmpty())
+        return;
+
+    // If the playlist is sorted the rows don't matter, turning sorting back on
+    // at the end sorts once.
+
+    const bool sorting = isSortingEnabled();
+    if(sorting)
+        setSortingEnabled(false);
+
+    for(auto it = newItems.cend(); it != newItems.cbegin();) {
+        --it;
+        insertItemsAt(it.key(), it.value());
+    }
+
+    if(sorting) {
+        prepareSort(header()->sortIndicatorSection(), header()->sortIndicatorOrder());
+        setSortingEnabled(true);
+    }
+
+    playlistItemsChanged();
+    slotWeightDirty();
 }
 
 void Playlist::beginPlayingItem(PlaylistItem *itemToPlay)
@@ -1098,6 +1300,12 @@ void Playlist::takeItem(QTreeWidgetItem *item)
     QTreeWidget::takeTopLevelItem(index);
 }
 
+bool Playlist::hasItem(const QString &file) const
+{
+    const CollectionListItem *item = CollectionList::instance()->lookup(file);
+    return item && m_members.contains(item->storeId());
+}
+
 PlaylistItem *Playlist::createItem(const FileHandle &file, QTreeWidgetItem *after)
 {
     return createItem<PlaylistItem>(file, after);
@@ -1263,8 +1471,20 @@ void Playlist::showColumn(int c, bool updateSearch)
 
 void Playlist::sortByColumn(int column, Qt::SortOrder order)
 {
+    prepareSort(column, order);
+
+    if(isSortingEnabled()) {
+        QTreeWidget::sortByColumn(column, order);
+        return;
+    }
+
+    // Enabling sorting sorts by the sort indicator, so set that first rather
+    // than sorting twice.
+    {
+        const QSignalBlocker blocker(header());
+        header()->setSortIndicator(column, order);
+    }
     setSortingEnabled(true);
-    QTreeWidget::sortByColumn(column, order);
 }
 
 // This function is called during startup so it cannot rely on any virtual
@@ -1363,9 +1583,17 @@ void Playlist::slotInitialize(int numColumnsToReserve)
 
 void Playlist::setupItem(PlaylistItem *item)
 {
+    ++m_itemsGeneration;
+
     item->setTrackId(g_trackID);
     g_trackID++;
 
+    // CollectionListItems are counted by CollectionListItem::refresh(), which
+    // has already run by now.
+
+    if(item->collectionItem() != item)
+        addToTotals(item->storeId(), 1);
+
     QModelIndex index = indexFromItem(item);
     if(!m_search->isEmpty())
         item->setHidden(!m_search->checkItem(&index));
@@ -1377,6 +1605,47 @@ void Playlist::setupItem(PlaylistItem *item)
     }
 }
 
+bool Playlist::insertMember(const CollectionListItem *item)
+{
+    return m_members.insert(item->storeId());
+}
+
+void Playlist::insertItems(const QList<QTreeWidgetItem *> &items, QTreeWidgetItem *after)
+{
+    if(items.isEmpty())
+        return;
+
+    // With sorting enabled Qt would insert the items one at a time and sort
+    // them in later anyway, so put them all in unsorted and have turning
+    // sorting back on sort them once.
+
+    const bool sorting = isSortingEnabled();
+    if(sorting)
+        setSortingEnabled(false);
+
+    insertItemsAt(after ? indexOfTopLevelItem(after) + 1 : 0, items);
+
+    if(sorting) {
+        prepareSort(header()->sortIndicatorSection(), header()->sortIndicatorOrder());
+        setSortingEnabled(true);
+    }
+
+    playlistItemsChanged();
+    slotWeightDirty();
+}
+
+void Playlist::insertItemsAt(int row, const QList<QTreeWidgetItem *> &items)
+{
+    insertTopLevelItems(row, items);
+
+    m_disableColumnWidthUpdates = true;
+
+    for(QTreeWidgetItem *item : items)
+        setupItem(static_cast<PlaylistItem *>(item));
+
+    m_disableColumnWidthUpdates = false;
+}
+
 void Playlist::setDynamicListsFrozen(bool frozen)
 {
     m_collection->setDynamicListsFrozen(frozen);
@@ -1453,19 +1722,14 @@ void Playlist::setup(int numColumnsToReserve)
     connect(header(), &QHeaderView::sectionMoved,
             this,     &Playlist::slotColumnOrderChanged);
 
+    // This has to be connected before QTreeView connects its own sorting to
+    // the same signal, so the items are ranked before QTreeView sorts them.
+    connect(header(), &QHeaderView::sortIndicatorChanged,
+            this,     &Playlist::slotSortIndicatorChanged);
+
     connect(this, &QTreeWidget::itemDoubleClicked,
             this, &Playlist::slotPlayCurrent);
 
-    // Use a timer to soak up the multiple dataChanged signals we're going to get
-    auto updateRequestor = new QTimer(this);
-    updateRequestor->setSingleShot(true);
-    updateRequestor->setInterval(10);
-
-    connect(model(), &QAbstractItemModel::dataChanged,
-            updateRequestor, qOverload<>(&QTimer::start));
-    connect(updateRequestor, &QTimer::timeout,
-            this, &Playlist::slotUpdateTime);
-
     // This apparently must be created very early in initialization for other
     // Playlist code requiring m_headerMenu.
     m_columnVisibleAction = new KActionMenu(i18nc("@action:inmenu", "&Show Columns"), this);
@@ -1623,46 +1887,127 @@ void Playlist::calculateColumnWeights()
     if(m_disableColumnWidthUpdates)
         return;
 
-    const PlaylistItemList itemList = items();
-
-    QVector<double> averageWidth(columnCount());
-    double itemCount = itemList.size();
-
     // Here we're not using a real average, but averaging the squares of the
     // column widths and then using the square root of that value.  This gives
     // a nice weighting to the longer columns without doing something arbitrary
-    // like adding a fixed amount of padding.
-
-    for(const auto &item : itemList) {
-        const auto cachedWidth = item->cachedWidths();
-
-        // Extra columns start at 0, but those weights aren't shared with all
-        // items.
-        for(int i = 0; i < columnOffset(); ++i) {
-            const auto width = columnWidth(i);
-            averageWidth[i] += width * width / itemCount;
-        }
+    // like adding a fixed amount of padding.  The sums of the squares are kept
+    // by addToTotals(), so the items don't have to be looked at here.
 
-        const auto offset = columnOffset();
-        for(int column = offset; column < columnCount(); ++column) {
-            const auto width = cachedWidth[column - offset];
-            averageWidth[column] += width * width / itemCount;
-        }
-    }
+    const int itemCount = topLevelItemCount();
+    const int offset = columnOffset();
 
     if(m_columnWeights.isEmpty())
         m_columnWeights.fill(-1, columnCount());
 
     for(const auto column : as_const(m_weightDirty)) {
-        if (column >= m_columnWeights.size() || column >= averageWidth.size()) {
+        if (column >= m_columnWeights.size() || column >= columnCount()) {
             continue;
         }
-        m_columnWeights[column] = int(std::sqrt(averageWidth[column]) + 0.5);
+
+        double averageWidth = 0;
+
+        if(itemCount > 0) {
+            // Extra columns start at 0, but those weights aren't shared with
+            // all items.
+            if(column < offset) {
+                const double width = columnWidth(column);
+                averageWidth = width * width;
+            }
+            else if(column - offset < m_widthSquares.size())
+                averageWidth = double(m_widthSquares[column - offset]) / itemCount;
+        }
+
+        m_columnWeights[column] = int(std::sqrt(averageWidth) + 0.5);
     }
 
     m_weightDirty.clear();
 }
 
+void Playlist::addToTotals(TrackStore::Id id, int sign)
+{
+    const TrackStore *store = TrackStore::instance();
+    const int columns = PlaylistItem::lastColumn() + 1;
+
+    if(m_widthSquares.isEmpty())
+        m_widthSquares.fill(0, columns);
+
+    m_time += sign * store->seconds(id);
+
+    for(int column = 0; column < columns; ++column) {
+        const qint64 width = store->width(id, column);
+        m_widthSquares[column] += sign * width * width;
+    }
+}
+
+void Playlist::prepareSort(int column, Qt::SortOrder order)
+{
+    if(hasSortRanks(column, order))
+        return;
+
+    const int offset = columnOffset();
+    const int sortColumn = column - offset;
+
+    if(topLevelItemCount() < concurrentSortSize || !PlaylistItem::isStoreColumn(sortColumn)) {
+        m_rankedSortColumn = -1;
+        return;
+    }
+
+    // Ties are broken the same way PlaylistItem::compare() does.
+
+    QVector<int> tieBreakColumns;
+    const int last = !isColumnHidden(PlaylistItem::AlbumColumn + offset)
+        ? PlaylistItem::TrackNumberColumn
+        : PlaylistItem::ArtistColumn;
+
+    for(int i = PlaylistItem::ArtistColumn; i <= last; ++i) {
+        if(!isColumnHidden(i + offset))
+            tieBreakColumns.append(i);
+    }
+    tieBreakColumns.append(PlaylistItem::TrackColumn);
+
+    struct SortEntry
+    {
+        TrackStore::Id id;
+        PlaylistItem *item;
+    };
+
+    QVector<SortEntry> entries;
+    entries.reserve(topLevelItemCount());
+    for(int i = 0; i < topLevelItemCount(); ++i) {
+        const auto item = static_cast<PlaylistItem *>(topLevelItem(i));
+        entries.append({ item->storeId(), item });
+    }
+
+    const bool ascending = order == Qt::AscendingOrder;
+    concurrentStableSort(entries,
+        [sortColumn, ascending, &tieBreakColumns](const SortEntry &a, const SortEntry &b) {
+            const int c = PlaylistItem::compareTracks(a.id, b.id, sortColumn, tieBreakColumns);
+            return ascending ? c < 0 : c > 0;
+        });
+
+    for(int i = 0; i < entries.size(); ++i)
+        entries[i].item->m_sortRank = i;
+
+    m_rankedSortColumn = column;
+    m_rankedSortOrder = order;
+    m_rankedItemsGeneration = m_itemsGeneration;
+    m_rankedItemCount = entries.size();
+
+    // The ranks are only good for the sort about to happen.
+    QTimer::singleShot(0, this, [this]() { m_rankedSortColumn = -1; });
+}
+
+bool Playlist::hasSortRanks(int column, Qt::SortOrder order) const
+{
+    // Any item added or removed since the ranking has no rank or leaves a
+    // gap, the generation catches both.
+
+    return m_rankedSortColumn >= 0 &&
+        column == m_rankedSortColumn && order == m_rankedSortOrder &&
+        m_rankedItemsGeneration == m_itemsGeneration &&
+        m_rankedItemCount == topLevelItemCount();
+}
+
 void Playlist::addPlaylistFile(const QString &m3uFile)
 {
     if(!m_collection->containsPlaylistFile(m3uFile)) {
@@ -1674,6 +2019,11 @@ QFuture<void> Playlist::addFilesFromDirectory(const QString &dirPath)
 {
     auto loader = new DirectoryLoader(dirPath);
 
+    // Files found before are already in the collection, so only directories
+    // that changed since need to be looked at again.
+    if(this == CollectionList::instance())
+        loader->setDirectoryIndex(DirectoryIndex::instance());
+
     connect(loader, &DirectoryLoader::loadedPlaylist, this,
         [this](const QString &m3uFile) {
             addPlaylistFile(m3uFile);
@@ -2136,18 +2486,10 @@ void Playlist::slotPlayCurrent()
     refillRandomList();
 }
 
-void Playlist::slotUpdateTime()
+void Playlist::slotSortIndicatorChanged(int column, Qt::SortOrder order)
 {
-    int newTime = 0;
-    QTreeWidgetItemIterator it(this);
-    while(*it) {
-        const auto item = static_cast<const PlaylistItem*>(*it);
-        ++it;
-
-        newTime += item->file().tag()->seconds();
-    }
-
-    m_time = newTime;
+    if(isSortingEnabled() && column >= 0 && column < columnCount())
+        prepareSort(column, order);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
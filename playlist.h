@@ -29,6 +29,7 @@
 #include "tagguesser.h"
 #include "playlistinterface.h"
 #include "filehandle.h"
+#include "trackstore.h"
 #include "juk_debug.h"
 
 class KActionMenu;
@@ -117,7 +118,9 @@ public:
 
     /**
      * Remove \a items from the playlist and emit a signal indicating
-     * that the number of items in the list has changed.
+     * that the number of items in the list has changed.  The bookkeeping for
+     * all of the items is done in one pass, so this is much faster than
+     * calling clearItem() for each of them.
      */
     virtual void clearItems(const PlaylistItemList &items);
 
@@ -319,6 +322,18 @@ public:
      */
     void applySharedSettings();
 
+    /**
+     * Goes up whenever an item is added to or removed from the playlist, but
+     * not when the items change.  Used by DynamicPlaylist to tell the two
+     * apart.
+     */
+    quint32 itemsGeneration() const { return m_itemsGeneration; }
+
+    /**
+     * Returns the model index of \p item, which must be in this playlist.
+     */
+    QModelIndex indexOf(const PlaylistItem *item) const { return indexFromItem(item); }
+
     void read(QDataStream &s);
 
     static void setShuttingDown() { m_shuttingDown = true; }
@@ -417,7 +432,9 @@ protected:
      * the same items are present in this Playlist as in @p itemList.
      *
      * No ordering guarantees are imposed, just that the playlist will have the
-     * same items as in the given list afterwards.
+     * same items as in the given list afterwards.  Items which are already
+     * present are kept, new ones are put after the item preceding them in
+     * @p itemList where there is one.
      */
     void synchronizeItemsTo(const PlaylistItemList &itemList);
 
@@ -449,7 +466,7 @@ protected:
     virtual void insertItem(QTreeWidgetItem *item);
     virtual void takeItem(QTreeWidgetItem *item);
 
-    virtual bool hasItem(const QString &file) const { return m_members.contains(file); }
+    virtual bool hasItem(const QString &file) const;
 
     /**
      * Do some final initialization of created items.  Notably ensure that they
@@ -555,6 +572,27 @@ private:
      */
     void calculateColumnWeights();
 
+    /**
+     * Adds the length of track \p id and the squares of its text widths to
+     * the running totals used for time() and the column weights, or takes
+     * them away again if \p sign is -1.
+     */
+    void addToTotals(TrackStore::Id id, int sign);
+
+    /**
+     * For large playlists sorted by a column the TrackStore can compare, this
+     * works out the order of the items on all cores and ranks them, so that
+     * the following sort by QTreeWidget only has to compare the ranks.
+     */
+    void prepareSort(int column, Qt::SortOrder order);
+
+    /**
+     * Returns true if every item has a rank from prepareSort() for \p column
+     * and \p order.  Ranks and compare() can't be mixed within a sort, so
+     * either all comparisons use the ranks or none do.
+     */
+    bool hasSortRanks(int column, Qt::SortOrder order) const;
+
     void addPlaylistFile(const QString &m3uFile);
     QFuture<void> addFilesFromDirectory(const QString &dirPath);
     QFuture<void> addUntypedFile(const QString &file, PlaylistItem *after = nullptr);
@@ -582,6 +620,25 @@ private:
      */
     CollectionListItem *collectionListItem(const FileHandle &file);
 
+    /**
+     * Also a helper for template<> createItem().  Records the track of \p item
+     * as being in this playlist, and returns true if it already was.
+     */
+    bool insertMember(const CollectionListItem *item);
+
+    /**
+     * Also a helper for template<> createItems().  Inserts \p items, which
+     * aren't in any tree yet, after \p after (or at the top if it's null) in
+     * one go and sets them up.
+     */
+    void insertItems(const QList<QTreeWidgetItem *> &items, QTreeWidgetItem *after);
+
+    /**
+     * Puts \p items in at \p row and sets them up, leaving the sorting and
+     * telling about the new items to the caller.
+     */
+    void insertItemsAt(int row, const QList<QTreeWidgetItem *> &items);
+
     /**
      * This class is used internally to store settings that are shared by all
      * of the playlists, such as column order.  It is implemented as a singleton.
@@ -642,13 +699,14 @@ private slots:
     void columnResized(int column, int oldSize, int newSize);
 
     void slotPlayCurrent();
-    void slotUpdateTime();
+    void slotSortIndicatorChanged(int column, Qt::SortOrder order);
 
 private:
     friend class PlaylistItem;
+    friend class CollectionListItem;
 
     PlaylistCollection *m_collection = nullptr;
-    StringHash m_members;
+    Hash<TrackStore::Id> m_members;
 
     // This is only defined if the playlist name is something other than the
     // file name.
@@ -657,11 +715,13 @@ private:
 
     int  m_time            = 0;
     bool m_allowDuplicates = true;
+    quint32 m_itemsGeneration = 0;
 
     /**
      * The average minimum widths of columns to be used in balancing calculations.
      */
     QVector<int> m_columnWeights;
+    QVector<qint64> m_widthSquares;
     QVector<int> m_columnFixedWidths;
     QVector<int> m_weightDirty;
     KActionMenu *m_columnVisibleAction = nullptr;
@@ -680,6 +740,12 @@ private:
     int  m_itemsLoading = 0; /// Count of pending file loads outstanding
     bool m_blockDataChanged = false;
 
+    /// The column (and order) the items are ranked for, see prepareSort()
+    int m_rankedSortColumn = -1;
+    Qt::SortOrder m_rankedSortOrder = Qt::AscendingOrder;
+    quint32 m_rankedItemsGeneration = 0;
+    int m_rankedItemCount = 0;
+
     QAction *m_rmbEdit  = nullptr;
     QMenu *m_rmbMenu    = nullptr;
     QMenu *m_headerMenu = nullptr;
@@ -708,7 +774,7 @@ template <class ItemType>
 ItemType *Playlist::createItem(const FileHandle &file, QTreeWidgetItem *after)
 {
     CollectionListItem *item = collectionListItem(file);
-    if(item && (!m_members.insert(file.absFilePath()) || m_allowDuplicates)) {
+    if(item && (!insertMember(item) || m_allowDuplicates)) {
         auto i = new ItemType(item, this, after);
         setupItem(i);
         return i;
@@ -722,7 +788,7 @@ ItemType *Playlist::createItem(SiblingType *sibling, ItemType *after)
 {
     m_disableColumnWidthUpdates = true;
 
-    if(!m_members.insert(sibling->file().absFilePath()) || m_allowDuplicates) {
+    if(!insertMember(sibling->collectionItem()) || m_allowDuplicates) {
         after = new ItemType(sibling->collectionItem(), this, after);
         setupItem(after);
     }
@@ -738,12 +804,18 @@ void Playlist::createItems(const Container<SiblingType *> &siblings, ItemType *a
     if(siblings.isEmpty())
         return;
 
+    // The items are built outside of the tree and added in one go, rather
+    // than having Qt look up and announce every row on its own.
+
+    QList<QTreeWidgetItem *> newItems;
+    newItems.reserve(siblings.size());
+
     for(auto *sibling : siblings) {
-        after = createItem(sibling, after);
+        if(!insertMember(sibling->collectionItem()) || m_allowDuplicates)
+            newItems.append(new ItemType(sibling->collectionItem()));
     }
 
-    playlistItemsChanged();
-    slotWeightDirty();
+    insertItems(newItems, after);
 }
 
 #endif
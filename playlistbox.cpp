@@ -157,10 +157,8 @@ PlaylistBox::PlaylistBox(PlayerManager *player, QWidget *parent, QStackedWidget
     setupUpcomingPlaylist();
 
     const auto *collectionList = CollectionList::instance();
-    connect(collectionList, &CollectionList::signalNewTag,
-            this,           &PlaylistBox::slotAddItem);
-    connect(collectionList, &CollectionList::signalRemovedTag,
-            this,           &PlaylistBox::slotRemoveItem);
+    connect(collectionList, &CollectionList::signalCollectionUpdated,
+            this,           &PlaylistBox::slotCollectionUpdated);
     connect(collectionList, &CollectionList::cachedItemsLoaded,
             this,           &PlaylistBox::slotLoadCachedPlaylists);
 
@@ -291,12 +289,7 @@ void PlaylistBox::setupPlaylist(Playlist *playlist, const QString &iconName)
 
 void PlaylistBox::setupPlaylist(Playlist *playlist, const QString &iconName, Item *parentItem)
 {
-    connect(playlist, &Playlist::signalPlaylistItemsDropped,
-            this,     &PlaylistBox::slotPlaylistItemsDropped);
-    connect(playlist, &Playlist::signalMoveFocusAway,
-            this,     &PlaylistBox::signalMoveFocusAway);
-
-    PlaylistCollection::setupPlaylist(playlist, iconName);
+    connectPlaylist(playlist, iconName);
 
     if(parentItem)
         new Item(parentItem, iconName, playlist->name(), playlist);
@@ -304,6 +297,18 @@ void PlaylistBox::setupPlaylist(Playlist *playlist, const QString &iconName, Ite
         new Item(this, iconName, playlist->name(), playlist);
 }
 
+void PlaylistBox::attachPlaylist(Playlist *playlist, Item *item)
+{
+    connectPlaylist(playlist, item->iconName());
+    item->setPlaylist(playlist);
+}
+
+void PlaylistBox::removeItem(Item *item)
+{
+    removeNameFromDict(item->text());
+    delete item;
+}
+
 void PlaylistBox::removePlaylist(Playlist *playlist)
 {
     // Could be false if setup() wasn't run yet.
@@ -333,11 +338,14 @@ bool PlaylistBox::dropMimeData(QTreeWidgetItem *parent, int index, const QMimeDa
     }
 
     auto *playlistItem = static_cast<Item *>(parent);
-    if(!playlistItem) {
+    if(!playlistItem->playlist())
+        viewMode()->setupItemPlaylist(playlistItem);
+
+    auto *playlist = playlistItem->playlist();
+    if(!playlist) {
         return false;
     }
 
-    auto *playlist = playlistItem->playlist();
     const auto droppedUrls = data->urls();
     PlaylistItem *lastItem = nullptr;
 
@@ -381,6 +389,16 @@ void PlaylistBox::saveConfig()
     KSharedConfig::openConfig()->sync();
 }
 
+void PlaylistBox::connectPlaylist(Playlist *playlist, const QString &iconName)
+{
+    connect(playlist, &Playlist::signalPlaylistItemsDropped,
+            this,     &PlaylistBox::slotPlaylistItemsDropped);
+    connect(playlist, &Playlist::signalMoveFocusAway,
+            this,     &PlaylistBox::signalMoveFocusAway);
+
+    PlaylistCollection::setupPlaylist(playlist, iconName);
+}
+
 void PlaylistBox::remove()
 {
     const ItemList items = selectedBoxItems();
@@ -492,7 +510,14 @@ void PlaylistBox::slotSavePlaylists()
 
 void PlaylistBox::slotShowDropTarget()
 {
-    if(m_dropItem) raise(m_dropItem->playlist());
+    if(!m_dropItem)
+        return;
+
+    if(!m_dropItem->playlist())
+        viewMode()->setupItemPlaylist(m_dropItem);
+
+    if(m_dropItem->playlist())
+        raise(m_dropItem->playlist());
 }
 
 void PlaylistBox::slotUpdatePlayingPlaylist()
@@ -510,17 +535,19 @@ void PlaylistBox::slotClearPlayingIndicators()
     }
 }
 
-void PlaylistBox::slotAddItem(const QString &tag, unsigned column)
+void PlaylistBox::slotCollectionUpdated(const CollectionChanges &changes)
 {
-    for(auto &viewMode : as_const(m_viewModes)) {
-        viewMode->addItems(QStringList(tag), column);
+    for(auto it = changes.removedTags.cbegin(); it != changes.removedTags.cend(); ++it) {
+        for(const QString &tag : it.value()) {
+            for(auto &viewMode : as_const(m_viewModes))
+                viewMode->removeItem(tag, it.key());
+        }
     }
-}
 
-void PlaylistBox::slotRemoveItem(const QString &tag, unsigned column)
-{
-    for(auto &viewMode : as_const(m_viewModes)) {
-        viewMode->removeItem(tag, column);
+    for(auto it = changes.newTags.cbegin(); it != changes.newTags.cend(); ++it) {
+        const QStringList tags(it.value().cbegin(), it.value().cend());
+        for(auto &viewMode : as_const(m_viewModes))
+            viewMode->addItems(tags, it.key());
     }
 }
 
@@ -616,6 +643,9 @@ void PlaylistBox::slotPlaylistChanged()
 
     PlaylistList playlists;
     for(const auto &playlistBoxItem : items) {
+        if(!playlistBoxItem->playlist())
+            viewMode()->setupItemPlaylist(playlistBoxItem);
+
         auto p = playlistBoxItem->playlist();
         if(p) {
             playlists.append(p);
@@ -666,7 +696,14 @@ void PlaylistBox::slotDoubleClicked(QTreeWidgetItem *item)
 {
     if(!item)
         return;
-    auto *playlist = static_cast<Item *>(item)->playlist();
+
+    auto *boxItem = static_cast<Item *>(item);
+    if(!boxItem->playlist())
+        viewMode()->setupItemPlaylist(boxItem);
+
+    auto *playlist = boxItem->playlist();
+    if(!playlist)
+        return;
 
     slotClearPlayingIndicators();
     playlist->slotBeginPlayback();
@@ -694,7 +731,9 @@ void PlaylistBox::slotSetViewMode(int index)
 
 void PlaylistBox::setupItem(Item *item)
 {
-    m_playlistDict.insert(item->playlist(), item);
+    // View modes may add items which only get a playlist later on.
+    if(item->playlist())
+        m_playlistDict.insert(item->playlist(), item);
     viewMode()->queueRefresh();
 }
 
@@ -769,6 +808,13 @@ void PlaylistBox::Item::setPlaying(bool isPlaying)
     }
 }
 
+void PlaylistBox::Item::setPlaylist(Playlist *playlist)
+{
+    m_playlist = playlist;
+    listView()->setupItem(this);
+    connectPlaylist();
+}
+
 void PlaylistBox::Item::setup()
 {
     listView()->viewMode()->setupItem(this);
@@ -809,14 +855,8 @@ void PlaylistBox::Item::init()
     setIcon(0, QIcon::fromTheme(m_iconName));
     list->addNameToDict(itemText);
 
-    if(m_playlist) {
-        connect(m_playlist, &Playlist::signalNameChanged,
-                this,       &Item::slotSetName);
-        connect(m_playlist, &Playlist::signalEnableDirWatch,
-                this, [list](bool enable) {
-                    list->enableDirWatch(enable);
-                });
-    }
+    if(m_playlist)
+        connectPlaylist();
 
     if(m_playlist == CollectionList::instance()) {
         m_sortedFirst = true;
@@ -828,7 +868,18 @@ void PlaylistBox::Item::init()
         m_sortedFirst = true;
 
     setText(1, sortTextFor(itemText));
+}
+
+void PlaylistBox::Item::connectPlaylist()
+{
+    PlaylistBox *list = listView();
 
+    connect(m_playlist, &Playlist::signalNameChanged,
+            this,       &Item::slotSetName);
+    connect(m_playlist, &Playlist::signalEnableDirWatch,
+            this, [list](bool enable) {
+                list->enableDirWatch(enable);
+            });
     connect(&(m_playlist->signaller), &PlaylistInterfaceSignaller::playingItemDataChanged, this, &PlaylistBox::Item::playlistItemDataChanged);
 }
 
@@ -26,6 +26,7 @@
 class Playlist;
 class PlaylistItem;
 class ViewMode;
+struct CollectionChanges;
 
 class QMenu;
 
@@ -69,6 +70,18 @@ public:
 
     void setupPlaylist(Playlist *playlist, const QString &iconName, Item *parentItem = nullptr);
 
+    /**
+     * Sets up \p playlist as the playlist of \p item, which a view mode made
+     * without one so that the playlist is only created once it's needed.
+     */
+    void attachPlaylist(Playlist *playlist, Item *item);
+
+    /**
+     * Removes \p item, which has no playlist.  Items with a playlist are
+     * removed with it.
+     */
+    void removeItem(Item *item);
+
 public slots:
     void paste();
     void clear() {}
@@ -95,6 +108,8 @@ private:
     void readConfig();
     void saveConfig();
 
+    void connectPlaylist(Playlist *playlist, const QString &iconName);
+
     virtual void mousePressEvent(QMouseEvent *e) override;
     virtual void mouseReleaseEvent(QMouseEvent *e) override;
     virtual void keyPressEvent(QKeyEvent *e) override;
@@ -129,8 +144,7 @@ private slots:
     void slotUpdatePlayingPlaylist();
     void slotClearPlayingIndicators();
 
-    void slotAddItem(const QString &tag, unsigned column);
-    void slotRemoveItem(const QString &tag, unsigned column);
+    void slotCollectionUpdated(const CollectionChanges &changes);
 
     // Used to load the playlists after GUI setup.
     void slotLoadCachedPlaylists();
@@ -176,6 +190,7 @@ protected:
     QString text() const { return QTreeWidgetItem::text(0); }
 
     void setSortedFirst(bool first = true) { m_sortedFirst = first; }
+    void setPlaylist(Playlist *playlist);
     void setPlaying(bool isPlaying);
 
     virtual void setup();
@@ -192,6 +207,7 @@ protected slots:
 private:
     // setup() was already taken.
     void init();
+    void connectPlaylist();
     QString sortTextFor(const QString &name) const;
 
     Playlist *m_playlist;
@@ -46,9 +46,11 @@
 
 #include "actioncollection.h"
 #include "advancedsearchdialog.h"
+#include "cache.h"
 #include "collectionlist.h"
 #include "config-juk.h"
 #include "coverinfo.h"
+#include "directoryindex.h"
 #include "directorylist.h"
 #include "folderplaylist.h"
 #include "historyplaylist.h"
@@ -116,6 +118,7 @@ PlaylistCollection::~PlaylistCollection()
 {
     saveConfig();
     CollectionList::instance()->saveItemsToCache();
+    DirectoryIndex::instance()->save(Cache::instance()->generation());
     delete m_actionHandler;
     Playlist::setShuttingDown();
 }
@@ -41,6 +41,11 @@ static int naturalCompare(const QString &first, const QString &second)
     return collator.compare(first, second);
 }
 
+static int compareNumbers(int first, int second)
+{
+    return first < second ? -1 : (first > second ? 1 : 0);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // PlaylistItem public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -56,14 +61,21 @@ PlaylistItem::~PlaylistItem()
         m_collectionItem->removeChildItem(this);
     }
 
+    // Items which Playlist::clearItems() has already taken out of the tree
+    // have been accounted for there.
+
+    Playlist *p = playlist();
+
     if(m_playingItems.contains(this)) {
         m_playingItems.removeAll(this);
-        if(m_playingItems.isEmpty())
-            playlist()->setPlaying(0);
+        if(m_playingItems.isEmpty() && p)
+            p->setPlaying(0);
     }
 
-    playlist()->updateDeletedItem(this);
-    emit playlist()->signalAboutToRemove(this);
+    if(p) {
+        p->updateDeletedItem(this);
+        emit p->signalAboutToRemove(this);
+    }
 
     if(m_watched)
         Pointer::clear(this);
@@ -72,6 +84,7 @@ PlaylistItem::~PlaylistItem()
 void PlaylistItem::setFile(const FileHandle &file)
 {
     m_collectionItem->updateCollectionDict(d->fileHandle.absFilePath(), file.absFilePath());
+    d->fileHandle.detachFromStore(); // see FileHandle::setFile()
     d->fileHandle = file;
     refresh();
 }
@@ -91,49 +104,103 @@ FileHandle PlaylistItem::file() const
 
 QString PlaylistItem::text(int column) const
 {
-    if(!d->fileHandle.tag())
+    if(d->storeId == TrackStore::invalidId)
         return QString();
 
     int offset = playlist()->columnOffset();
 
     switch(column - offset) {
+    case FileNameColumn:
+        return d->fileHandle.absFilePath().section(QLatin1Char('/'), -1);
+    case FullPathColumn:
+        return d->fileHandle.absFilePath();
+    case CoverColumn:
+        return QString();
+    default:
+        if(isStoreColumn(column - offset))
+            return storeText(d->storeId, column - offset);
+        return QTreeWidgetItem::text(column);
+    }
+}
+
+// static
+QString PlaylistItem::storeText(TrackStore::Id id, int column)
+{
+    const TrackStore *store = TrackStore::instance();
+
+    switch(column) {
     case TrackColumn:
-        return d->fileHandle.tag()->title();
+        return store->title(id);
     case ArtistColumn:
-        return d->fileHandle.tag()->artist();
+        return store->artist(id);
     case AlbumColumn:
-        return d->fileHandle.tag()->album();
+        return store->album(id);
     case TrackNumberColumn:
-        return d->fileHandle.tag()->track() > 0
-            ? QString::number(d->fileHandle.tag()->track())
+        return store->track(id) > 0
+            ? QString::number(store->track(id))
             : QString();
     case GenreColumn:
-        return d->fileHandle.tag()->genre();
+        return store->genre(id);
     case YearColumn:
-        return d->fileHandle.tag()->year() > 0
-            ? QString::number(d->fileHandle.tag()->year())
+        return store->year(id) > 0
+            ? QString::number(store->year(id))
             : QString();
     case LengthColumn:
-        return d->fileHandle.tag()->lengthString();
+        return store->lengthString(id);
     case BitrateColumn:
-        return QString::number(d->fileHandle.tag()->bitrate());
+        return QString::number(store->bitrate(id));
     case CommentColumn:
-        return d->fileHandle.tag()->comment();
-    case FileNameColumn:
-        return d->fileHandle.fileInfo().fileName();
-    case FullPathColumn:
-        return d->fileHandle.fileInfo().absoluteFilePath();
-    case CoverColumn:
+        return store->comment(id);
+    default:
         return QString();
+    }
+}
+
+// static
+QString PlaylistItem::foldedStoreText(TrackStore::Id id, int column)
+{
+    const TrackStore *store = TrackStore::instance();
+
+    switch(column) {
+    case TrackColumn:
+        return store->foldedTitle(id);
+    case ArtistColumn:
+        return store->foldedString(store->artistId(id));
+    case AlbumColumn:
+        return store->foldedString(store->albumId(id));
+    case GenreColumn:
+        return store->foldedString(store->genreId(id));
+    case CommentColumn:
+        return store->foldedString(store->commentId(id));
     default:
-        return QTreeWidgetItem::text(column);
+        // The rest are numbers.
+        return storeText(id, column);
     }
 }
 
 void PlaylistItem::setText(int column, const QString &text)
 {
     QTreeWidgetItem::setText(column, text);
-    playlist()->slotWeightDirty(column);
+
+    // Items made to be inserted in a batch have no playlist yet, it looks at
+    // their widths once they're in.
+    if(playlist())
+        playlist()->slotWeightDirty(column);
+}
+
+QVariant PlaylistItem::data(int column, int role) const
+{
+    if(role == StoreIdRole)
+        return d->storeId;
+
+    if(role != Qt::DisplayRole && role != Qt::EditRole)
+        return QTreeWidgetItem::data(column, role);
+
+    const int offset = playlist()->columnOffset();
+    if(column < offset || column > CoverColumn + offset)
+        return QTreeWidgetItem::data(column, role);
+
+    return text(column);
 }
 
 bool PlaylistItem::isPlaying() const
@@ -199,9 +266,12 @@ Playlist *PlaylistItem::playlist() const
     return static_cast<Playlist *>(treeWidget());
 }
 
-QVector<int> PlaylistItem::cachedWidths() const
+int PlaylistItem::cachedWidth(int column) const
 {
-    return d->cachedWidths;
+    if(d->storeId == TrackStore::invalidId || column < 0 || column > lastColumn())
+        return 0;
+
+    return TrackStore::instance()->width(d->storeId, column);
 }
 
 void PlaylistItem::refresh()
@@ -240,6 +310,13 @@ PlaylistItem::PlaylistItem(CollectionListItem *item, Playlist *parent, QTreeWidg
     setup(item);
 }
 
+PlaylistItem::PlaylistItem(CollectionListItem *item) :
+    QTreeWidgetItem(),
+    d(0),
+    m_watched(0)
+{
+    setup(item);
+}
 
 // This constructor should only be used by the CollectionList subclass.
 
@@ -281,7 +358,7 @@ int PlaylistItem::compare(const QTreeWidgetItem *item, int column, bool ascendin
 
         for(int i = ArtistColumn; i <= last; i++) {
             if(!playlist()->isColumnHidden(i + offset)) {
-                c = compare(this, playlistItem, i, ascending);
+                c = compare(this, playlistItem, i + offset, ascending);
                 if(c != 0)
                     return c;
             }
@@ -303,46 +380,42 @@ int PlaylistItem::compare(const PlaylistItem *firstItem, const PlaylistItem *sec
         return naturalCompare(first, second);
     }
 
-    switch(column - offset) {
-    case TrackNumberColumn:
-        if(firstItem->d->fileHandle.tag()->track() > secondItem->d->fileHandle.tag()->track())
-            return 1;
-        else if(firstItem->d->fileHandle.tag()->track() < secondItem->d->fileHandle.tag()->track())
-            return -1;
-        else
-            return 0;
-        break;
-    case LengthColumn:
-        if(firstItem->d->fileHandle.tag()->seconds() > secondItem->d->fileHandle.tag()->seconds())
-            return 1;
-        else if(firstItem->d->fileHandle.tag()->seconds() < secondItem->d->fileHandle.tag()->seconds())
-            return -1;
-        else
-            return 0;
-        break;
-    case BitrateColumn:
-        if(firstItem->d->fileHandle.tag()->bitrate() > secondItem->d->fileHandle.tag()->bitrate())
-            return 1;
-        else if(firstItem->d->fileHandle.tag()->bitrate() < secondItem->d->fileHandle.tag()->bitrate())
-            return -1;
-        else
-            return 0;
-        break;
-    default:
-        return naturalCompare(firstItem->d->metadata[column - offset],
-                              secondItem->d->metadata[column - offset]);
-    }
+    if(isStoreColumn(column - offset))
+        return compareStoreColumn(firstItem->d->storeId, secondItem->d->storeId, column - offset);
+
+    return naturalCompare(firstItem->text(column), secondItem->text(column));
+}
+
+// static
+int PlaylistItem::compareTracks(TrackStore::Id first, TrackStore::Id second,
+                                int column, const QVector<int> &tieBreakColumns)
+{
+    int c = compareStoreColumn(first, second, column);
+
+    for(auto it = tieBreakColumns.cbegin(); c == 0 && it != tieBreakColumns.cend(); ++it)
+        c = compareStoreColumn(first, second, *it);
+
+    return c;
 }
 
 bool PlaylistItem::operator<(const QTreeWidgetItem &other) const
 {
-    bool ascending = playlist()->header()->sortIndicatorOrder() == Qt::AscendingOrder;
-    return compare(&other, playlist()->sortColumn(), ascending) == -1;
+    const Playlist *list = playlist();
+    const auto otherItem = static_cast<const PlaylistItem *>(&other);
+    const Qt::SortOrder order = list->header()->sortIndicatorOrder();
+
+    if(list->hasSortRanks(list->sortColumn(), order)) {
+        return order == Qt::AscendingOrder
+            ? m_sortRank < otherItem->m_sortRank
+            : m_sortRank > otherItem->m_sortRank;
+    }
+
+    return compare(&other, list->sortColumn(), order == Qt::AscendingOrder) < 0;
 }
 
 bool PlaylistItem::isValid() const
 {
-    return bool(d->fileHandle.tag());
+    return d->storeId != TrackStore::invalidId;
 }
 
 void PlaylistItem::setTrackId(quint32 id)
@@ -354,6 +427,35 @@ void PlaylistItem::setTrackId(quint32 id)
 // PlaylistItem private methods
 ////////////////////////////////////////////////////////////////////////////////
 
+// static
+int PlaylistItem::compareStoreColumn(TrackStore::Id first, TrackStore::Id second, int column)
+{
+    const TrackStore *store = TrackStore::instance();
+
+    switch(column) {
+    case TrackNumberColumn:
+        return compareNumbers(store->track(first), store->track(second));
+    case YearColumn:
+        return compareNumbers(store->year(first), store->year(second));
+    case LengthColumn:
+        return compareNumbers(store->seconds(first), store->seconds(second));
+    case BitrateColumn:
+        return compareNumbers(store->bitrate(first), store->bitrate(second));
+    case TrackColumn:
+        return store->compareTitles(first, second);
+    case ArtistColumn:
+        return store->compareStrings(store->artistId(first), store->artistId(second));
+    case AlbumColumn:
+        return store->compareStrings(store->albumId(first), store->albumId(second));
+    case GenreColumn:
+        return store->compareStrings(store->genreId(first), store->genreId(second));
+    case CommentColumn:
+        return store->compareStrings(store->commentId(first), store->commentId(second));
+    default:
+        return 0;
+    }
+}
+
 void PlaylistItem::setup(CollectionListItem *item)
 {
     m_collectionItem = item;
@@ -362,11 +464,16 @@ void PlaylistItem::setup(CollectionListItem *item)
     item->addChildItem(this);
     setFlags(flags() | Qt::ItemIsEditable | Qt::ItemIsDragEnabled);
 
+    // Items created outside of a tree are set up by Playlist::insertItems().
+
+    if(!playlist())
+        return;
+
     int offset = playlist()->columnOffset();
     int columns = lastColumn() + offset + 1;
 
     for(int i = offset; i < columns; i++) {
-        setText(i, text(i));
+        playlist()->slotWeightDirty(i);
     }
 }
 
@@ -24,6 +24,7 @@
 
 #include "tagguesser.h"
 #include "filehandle.h"
+#include "trackstore.h"
 #include "juk_debug.h"
 
 class Playlist;
@@ -91,13 +92,43 @@ public:
 
     static int lastColumn() { return FullPathColumn; }
 
+    /**
+     * The item data role under which the item's storeId() can be found, for
+     * code that only sees the model.
+     */
+    static constexpr int StoreIdRole = Qt::UserRole;
+
     void setFile(const FileHandle &file);
     void setFile(const QString &file);
     FileHandle file() const;
 
     virtual QString text(int column) const;
+
+    /**
+     * Returns the text track \p id shows in \p column (not counting any column
+     * offset), which must be one of the isStoreColumn()s.
+     */
+    static QString storeText(TrackStore::Id id, int column);
+
+    /**
+     * Same as storeText(), but case folded with TrackStore::fold().
+     */
+    static QString foldedStoreText(TrackStore::Id id, int column);
+
+    /**
+     * Returns true if \p column (not counting the column offset) is kept in
+     * the TrackStore.
+     */
+    static bool isStoreColumn(int column) { return column >= TrackColumn && column <= CommentColumn; }
+
     virtual void setText(int column, const QString &text);
 
+    /**
+     * Reimplemented to serve the text of the track's columns straight from
+     * the TrackStore instead of keeping a copy of each in the item.
+     */
+    QVariant data(int column, int role) const override;
+
     bool isPlaying() const;
     void setPlaying(bool playing = true, bool master = true);
 
@@ -116,9 +147,15 @@ public:
 
     /**
      * The widths of items are cached when they're updated for us in computations
-     * in the "weighted" listview column width mode.
+     * in the "weighted" listview column width mode.  \p column does not include
+     * the playlist's column offset.
      */
-    QVector<int> cachedWidths() const;
+    int cachedWidth(int column) const;
+
+    /**
+     * Returns the row of the TrackStore holding the metadata of this item.
+     */
+    TrackStore::Id storeId() const { return d->storeId; }
 
     /**
      * This just refreshes from the in memory data.  This may seem pointless at
@@ -164,6 +201,12 @@ protected:
     PlaylistItem(CollectionListItem *item, Playlist *parent);
     PlaylistItem(CollectionListItem *item, Playlist *parent, QTreeWidgetItem *after);
 
+    /**
+     * Creates an item which isn't in any Playlist yet, for Playlist::createItems()
+     * to insert along with others.
+     */
+    explicit PlaylistItem(CollectionListItem *item);
+
     /**
      * See the class documentation for an explanation of construction and deletion
      * of PlaylistItems.
@@ -173,6 +216,15 @@ protected:
     virtual int compare(const QTreeWidgetItem *item, int column, bool ascending) const;
     int compare(const PlaylistItem *firstItem, const PlaylistItem *secondItem, int column, bool ascending) const;
 
+    /**
+     * Compares two tracks the way compare() does, but only using what's in the
+     * TrackStore so that it's safe to use from several threads at once.
+     * \p column and \p tieBreakColumns must be store columns, not counting
+     * the column offset.
+     */
+    static int compareTracks(TrackStore::Id first, TrackStore::Id second,
+                             int column, const QVector<int> &tieBreakColumns);
+
     bool operator<(const QTreeWidgetItem &other) const override;
 
     bool isValid() const;
@@ -186,8 +238,7 @@ protected:
     struct Data : public QSharedData
     {
         FileHandle fileHandle; // Set within CollectionList
-        QVector<QString> metadata; ///< Artist, album, or genre tags.  Other columns unfilled
-        QVector<int> cachedWidths;
+        TrackStore::Id storeId = TrackStore::invalidId; ///< Owned by the CollectionListItem
     };
 
     using DataPtr = QExplicitlySharedDataPointer<Data>;
@@ -204,8 +255,11 @@ private:
 
     void setup(CollectionListItem *item);
 
+    static int compareStoreColumn(TrackStore::Id first, TrackStore::Id second, int column);
+
     CollectionListItem *m_collectionItem;
     quint32 m_trackId;
+    int m_sortRank = -1; ///< See Playlist::prepareSort()
     bool m_watched;
     static PlaylistItemList m_playingItems;
 };
@@ -16,12 +16,14 @@
  */
 
 #include <algorithm>
+#include <iterator>
 #include <QConcatenateTablesProxyModel>
 
 #include "playlistsearch.h"
 #include "playlist.h"
 #include "playlistitem.h"
 #include "collectionlist.h"
+#include "searchindex.h"
 #include "juk-exception.h"
 
 #include "juk_debug.h"
@@ -66,12 +68,15 @@ QModelIndexList PlaylistSearch::matchedItems() const{
 
 void PlaylistSearch::addPlaylist(Playlist* p)
 {
+    m_candidatesValid = false;
     static_cast<QConcatenateTablesProxyModel*>(sourceModel())->addSourceModel(p->model());
     m_playlists.append(p);
 }
 
 void PlaylistSearch::clearPlaylists()
 {
+    m_candidatesValid = false;
+    m_filtered = false;
     setSourceModel(new QConcatenateTablesProxyModel(this));
     m_playlists.clear();
 }
@@ -80,12 +85,16 @@ void PlaylistSearch::clearPlaylists()
 void PlaylistSearch::addComponent(const Component &c)
 {
     m_components.append(c);
+    m_candidatesValid = false;
+    m_filtered = false;
     invalidateFilter();
 }
 
 void PlaylistSearch::clearComponents()
 {
     m_components.clear();
+    m_candidatesValid = false;
+    m_filtered = false;
     invalidateFilter();
 }
 
@@ -113,12 +122,168 @@ bool PlaylistSearch::isEmpty() const
 }
 
 bool PlaylistSearch::filterAcceptsRow(int source_row, const QModelIndex & source_parent) const{
-    QAbstractItemModel* const model = sourceModel();
-    auto matcher = [&](Component c){
-        return c.matches(source_row, source_parent, model);
-    };
-    return m_mode == MatchAny? std::any_of(m_components.begin(), m_components.end(), matcher) :
-        std::all_of(m_components.begin(), m_components.end(), matcher);
+    if(!m_candidatesValid)
+        updateCandidates();
+
+    TrackStore::Id id = TrackStore::invalidId;
+    if(m_storeColumns)
+        id = sourceModel()->index(source_row, 0, source_parent).data(PlaylistItem::StoreIdRole).toUInt();
+
+    if(m_narrowed && id != TrackStore::invalidId &&
+       !std::binary_search(m_previousTracks.cbegin(), m_previousTracks.cend(), id) &&
+       !SearchIndex::instance()->changedSince(id, m_previousGeneration))
+    {
+        return false;
+    }
+
+    for(int i = 0; i < m_components.size(); ++i) {
+        const bool match = componentMatches(i, source_row, source_parent, id);
+
+        if(m_mode == MatchAny && match)
+            return true;
+        if(m_mode == MatchAll && !match)
+            return false;
+    }
+
+    return m_mode == MatchAll;
+}
+
+void PlaylistSearch::narrowFrom(const PlaylistSearch *previous)
+{
+    if(!previous || previous == this || !previous->m_filtered || !previous->m_storeColumns ||
+       previous->m_playlists != m_playlists ||
+       previous->m_mode != m_mode ||
+       previous->m_components.size() != m_components.size())
+    {
+        return;
+    }
+
+    for(int i = 0; i < m_components.size(); ++i) {
+        if(!m_components.at(i).narrows(previous->m_components.at(i)))
+            return;
+    }
+
+    const int matchCount = previous->rowCount();
+    m_previousTracks.reserve(matchCount);
+
+    for(int row = 0; row < matchCount; ++row) {
+        const QModelIndex index = previous->mapToSource(previous->index(row, 0));
+        m_previousTracks.append(index.data(PlaylistItem::StoreIdRole).toUInt());
+    }
+
+    std::sort(m_previousTracks.begin(), m_previousTracks.end());
+    m_previousTracks.erase(std::unique(m_previousTracks.begin(), m_previousTracks.end()),
+                           m_previousTracks.end());
+
+    m_previousGeneration = previous->m_filterGeneration;
+
+    // Only the rows there are now were checked by previous, rows added to the
+    // playlists later have to be checked in full.  So filter them right away
+    // and forget about previous again.
+
+    m_narrowed = true;
+    invalidateFilter();
+    rowCount();
+    m_narrowed = false;
+
+    m_previousTracks.clear();
+    m_previousTracks.squeeze();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+void PlaylistSearch::updateCandidates() const
+{
+    SearchIndex *index = SearchIndex::instance();
+
+    // Tracks changed after the rows were first checked might not match
+    // anymore, remember which those are for narrowFrom().
+
+    if(!m_filtered) {
+        m_filterGeneration = index->generation();
+        m_filtered = true;
+    }
+
+    // Rows can only be matched through their track if the columns are the
+    // plain PlaylistItem ones.
+
+    m_storeColumns = std::all_of(m_playlists.cbegin(), m_playlists.cend(),
+        [](const Playlist *playlist) { return playlist->columnOffset() == 0; });
+
+    m_candidates.fill(Candidates(), m_components.size());
+    m_candidatesValid = true;
+
+    if(!m_storeColumns)
+        return;
+
+    for(int i = 0; i < m_components.size(); ++i) {
+        const Component &component = m_components.at(i);
+        Candidates &candidates = m_candidates[i];
+
+        if(component.isPatternSearch())
+            continue;
+
+        candidates.indexed = true;
+        candidates.generation = index->generation();
+
+        const ColumnList columns = component.columns();
+        QVector<TrackStore::Id> columnTracks;
+
+        for(int column : columns) {
+            if(!SearchIndex::isIndexedColumn(column))
+                continue;
+
+            if(!index->candidates(column, component.query(), &columnTracks)) {
+                candidates.indexed = false;
+                candidates.tracks.clear();
+                break;
+            }
+
+            QVector<TrackStore::Id> tracks;
+            std::set_union(candidates.tracks.cbegin(), candidates.tracks.cend(),
+                           columnTracks.cbegin(), columnTracks.cend(),
+                           std::back_inserter(tracks));
+            candidates.tracks.swap(tracks);
+        }
+    }
+}
+
+bool PlaylistSearch::componentMatches(int component, int row, const QModelIndex &parent, TrackStore::Id id) const
+{
+    const Component &c = m_components.at(component);
+
+    // Regular expressions can't be looked up in the index.
+    if(c.isPatternSearch() || id == TrackStore::invalidId)
+        return c.matches(row, parent, sourceModel());
+
+    // The text of the indexed columns only has to be checked if the index
+    // lists the track, or if it changed since it was looked up.
+
+    const Candidates &candidates = m_candidates.at(component);
+    const bool skipIndexed = candidates.indexed &&
+        !std::binary_search(candidates.tracks.cbegin(), candidates.tracks.cend(), id) &&
+        !SearchIndex::instance()->changedSince(id, candidates.generation);
+
+    const ColumnList columns = c.columns();
+
+    for(int column : columns) {
+        if(PlaylistItem::isStoreColumn(column)) {
+            if(skipIndexed && SearchIndex::isIndexedColumn(column))
+                continue;
+
+            const QString text = c.isCaseSensitive()
+                ? PlaylistItem::storeText(id, column)
+                : PlaylistItem::foldedStoreText(id, column);
+            if(c.matchesFolded(text))
+                return true;
+        }
+        else if(c.matchesText(sourceModel()->index(row, column, parent).data().toString()))
+            return true;
+    }
+
+    return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -138,6 +303,7 @@ PlaylistSearch::Component::Component(const QString &query,
                                      const ColumnList &columns,
                                      MatchMode mode) :
     m_query(query),
+    m_foldedQuery(caseSensitive ? query : TrackStore::fold(query)),
     m_columns(columns),
     m_mode(mode),
     m_searchAllVisible(columns.isEmpty()),
@@ -166,53 +332,75 @@ bool PlaylistSearch::Component::matches(int row, QModelIndex parent, QAbstractIt
             return str.contains(m_queryRe);
         }
 
-        switch(m_mode) {
-        case Contains:
-            if(str.contains(m_query, m_caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive))
-                return true;
-            break;
-        case Exact:
-            // If lengths match, move on to check strings themselves
-            if(str.length() == m_query.length() &&
-               (( m_caseSensitive && str == m_query) ||
-                (!m_caseSensitive && str.toLower() == m_query.toLower()))
-               )
-            {
-                return true;
-            }
-            break;
-        case ContainsWord:
-        {
-            int i = str.indexOf(m_query, 0, m_caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+        if(matchesText(str))
+            return true;
+    };
+    return false;
+}
 
-            if(i >= 0) {
+bool PlaylistSearch::Component::matchesText(const QString &str) const
+{
+    return matchesFolded(m_caseSensitive ? str : TrackStore::fold(str));
+}
 
-                // If we found the pattern and the lengths are the same, then
-                // this is a match.
+bool PlaylistSearch::Component::matchesFolded(QStringView str) const
+{
+    switch(m_mode) {
+    case Contains:
+        return str.indexOf(m_foldedQuery) >= 0;
+    case Exact:
+        return str == m_foldedQuery;
+    case ContainsWord:
+    {
+        const qsizetype i = str.indexOf(m_foldedQuery);
 
-                if(str.length() == m_query.length())
-                    return true;
+        if(i >= 0) {
 
-                // First: If the match starts at the beginning of the text or the
-                // character before the match is not a word character
+            // If we found the pattern and the lengths are the same, then
+            // this is a match.
 
-                // AND
+            if(str.length() == m_foldedQuery.length())
+                return true;
 
-                // Second: Either the pattern was found at the end of the text,
-                // or the text following the match is a non-word character
+            // First: If the match starts at the beginning of the text or the
+            // character before the match is not a word character
 
-                // ...then we have a match
+            // AND
 
-                if((i == 0 || !str.at(i - 1).isLetterOrNumber()) &&
-                    (i + m_query.length() == str.length() || !str.at(i + m_query.length()).isLetterOrNumber()))
-                    return true;
-            }
-        }
+            // Second: Either the pattern was found at the end of the text,
+            // or the text following the match is a non-word character
+
+            // ...then we have a match
+
+            if((i == 0 || !str.at(i - 1).isLetterOrNumber()) &&
+                (i + m_foldedQuery.length() == str.length() || !str.at(i + m_foldedQuery.length()).isLetterOrNumber()))
+                return true;
         }
-    };
+    }
+    }
+
     return false;
 }
 
+bool PlaylistSearch::Component::narrows(const Component &other) const
+{
+    if(*this == other)
+        return true;
+
+    // Only a substring search gets narrower as its query grows, a word can
+    // stop being one and exact matches don't overlap at all.
+
+    if(m_re || other.m_re ||
+       m_mode != Contains || other.m_mode != Contains ||
+       m_caseSensitive != other.m_caseSensitive ||
+       m_columns != other.m_columns)
+    {
+        return false;
+    }
+
+    return m_foldedQuery.contains(other.m_foldedQuery);
+}
+
 bool PlaylistSearch::Component::operator==(const Component &v) const
 {
     return m_query == v.m_query &&
@@ -18,9 +18,12 @@
 #define PLAYLISTSEARCH_H
 
 #include <QRegularExpression>
+#include <QStringView>
 #include <QVector>
 #include <QSortFilterProxyModel>
 
+#include "trackstore.h"
+
 class Playlist;
 class PlaylistItem;
 
@@ -70,11 +73,50 @@ public:
      */
     void clearItem(PlaylistItem *item);
 
+    /**
+     * When the query is only extended, e.g. as another character is typed,
+     * nothing that \p previous didn't match can match this search.  If every
+     * component of this search narrows down the one of \p previous, this
+     * restricts the search to the tracks \p previous matched (and those that
+     * changed since), so that the rest needn't be checked again.  Otherwise
+     * this search will look at every row.
+     *
+     * Only the rows there are when this is called are restricted, they are
+     * filtered right away.  This must be called before the search is first
+     * used.
+     */
+    void narrowFrom(const PlaylistSearch *previous);
+
 private:
+    /**
+     * The tracks the SearchIndex says may match a component, see
+     * updateCandidates().
+     */
+    struct Candidates
+    {
+        bool indexed = false;
+        quint32 generation = 0;
+        QVector<TrackStore::Id> tracks;
+    };
+
+    void updateCandidates() const;
+    bool componentMatches(int component, int row, const QModelIndex &parent, TrackStore::Id id) const;
 
+private:
     PlaylistList m_playlists;
     ComponentList m_components;
     SearchMode m_mode;
+
+    mutable QVector<Candidates> m_candidates;
+    mutable bool m_candidatesValid = false;
+    mutable bool m_storeColumns = false;
+
+    mutable quint32 m_filterGeneration = 0;
+    mutable bool m_filtered = false;
+
+    QVector<TrackStore::Id> m_previousTracks;
+    quint32 m_previousGeneration = 0;
+    bool m_narrowed = false;
 };
 
 /**
@@ -111,6 +153,24 @@ public:
     ColumnList columns() const { return m_columns; }
 
     bool matches(int row, QModelIndex parent, QAbstractItemModel* model) const;
+
+    /**
+     * Returns true if \p str matches the query.  Not for pattern searches.
+     */
+    bool matchesText(const QString &str) const;
+
+    /**
+     * Same as matchesText(), but unless the search is case sensitive \p str
+     * must already be folded with TrackStore::fold(), as the query is once
+     * when the component is made.
+     */
+    bool matchesFolded(QStringView str) const;
+
+    /**
+     * Returns true if everything this component matches is also matched by
+     * \p other, as when the query of \p other is extended.
+     */
+    bool narrows(const Component &other) const;
     bool isPatternSearch() const { return m_re; }
     bool isCaseSensitive() const { return m_caseSensitive; }
     MatchMode matchMode() const { return m_mode; }
@@ -119,6 +179,7 @@ public:
 
 private:
     QString m_query;
+    QString m_foldedQuery;
     QRegularExpression m_queryRe;
     mutable ColumnList m_columns;
     MatchMode m_mode;
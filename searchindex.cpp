@@ -0,0 +1,227 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <algorithm>
+#include <iterator>
+
+#include "playlistitem.h"
+#include "juk_debug.h"
+
+// Stale entries are only dropped by a rebuild, which happens once there have
+// been as many changes as there are tracks (but no fewer than this).
+static const int minimumRebuildChanges = 1000;
+
+// Returns the slot in SearchIndex::m_postings for a column, or -1.
+static int indexSlot(int column)
+{
+    switch(column) {
+    case PlaylistItem::TrackColumn:
+        return 0;
+    case PlaylistItem::ArtistColumn:
+        return 1;
+    case PlaylistItem::AlbumColumn:
+        return 2;
+    case PlaylistItem::GenreColumn:
+        return 3;
+    case PlaylistItem::CommentColumn:
+        return 4;
+    default:
+        return -1;
+    }
+}
+
+static QString columnText(const TrackStore *store, TrackStore::Id id, int slot)
+{
+    switch(slot) {
+    case 0:
+        return store->title(id);
+    case 1:
+        return store->artist(id);
+    case 2:
+        return store->album(id);
+    case 3:
+        return store->genre(id);
+    default:
+        return store->comment(id);
+    }
+}
+
+// The characters are folded like TrackStore::fold() does, which is what
+// searches ignoring case compare, so anything they find has all of its
+// trigrams here.
+template<typename Function>
+static void forEachTrigram(const QString &text, Function f)
+{
+    if(text.size() < 3)
+        return;
+
+    quint64 a = text.at(0).toCaseFolded().unicode();
+    quint64 b = text.at(1).toCaseFolded().unicode();
+
+    for(int i = 2; i < text.size(); ++i) {
+        const quint64 c = text.at(i).toCaseFolded().unicode();
+        f((a << 32) | (b << 16) | c);
+        a = b;
+        b = c;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// public methods
+////////////////////////////////////////////////////////////////////////////////
+
+SearchIndex *SearchIndex::instance()
+{
+    static SearchIndex index;
+    return &index;
+}
+
+// static
+bool SearchIndex::isIndexedColumn(int column)
+{
+    return indexSlot(column) >= 0;
+}
+
+void SearchIndex::update(TrackStore::Id id)
+{
+    ++m_generation;
+
+    if(id >= quint32(m_changed.size()))
+        m_changed.resize(id + 1);
+    m_changed[id] = m_generation;
+
+    if(!m_built)
+        return;
+
+    // Whatever the track contained before stays listed until the next
+    // rebuild, candidates are checked anyways.
+
+    add(id);
+
+    if(++m_staleCount > qMax(minimumRebuildChanges, TrackStore::instance()->count()))
+        m_built = false;
+}
+
+bool SearchIndex::candidates(int column, const QString &text, QVector<TrackStore::Id> *tracks)
+{
+    const int slot = indexSlot(column);
+
+    if(slot < 0 || text.size() < 3)
+        return false;
+
+    if(!m_built)
+        rebuild();
+
+    QHash<Trigram, Postings> &postings = m_postings[slot];
+    QVector<const QVector<TrackStore::Id> *> lists;
+    bool missing = false;
+
+    forEachTrigram(text, [&postings, &lists, &missing](Trigram trigram) {
+        const auto it = postings.find(trigram);
+        if(it == postings.end()) {
+            missing = true;
+            return;
+        }
+
+        if(!it->sorted) {
+            std::sort(it->tracks.begin(), it->tracks.end());
+            it->tracks.erase(std::unique(it->tracks.begin(), it->tracks.end()), it->tracks.end());
+            it->sorted = true;
+        }
+
+        lists.append(&it->tracks);
+    });
+
+    tracks->clear();
+
+    if(missing)
+        return true;
+
+    std::sort(lists.begin(), lists.end(),
+        [](const QVector<TrackStore::Id> *a, const QVector<TrackStore::Id> *b) {
+            return a->size() < b->size();
+        });
+
+    *tracks = *lists.first();
+
+    for(int i = 1; i < lists.size() && !tracks->isEmpty(); ++i) {
+        QVector<TrackStore::Id> intersection;
+        std::set_intersection(tracks->cbegin(), tracks->cend(),
+                              lists.at(i)->cbegin(), lists.at(i)->cend(),
+                              std::back_inserter(intersection));
+        tracks->swap(intersection);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchIndex::rebuild()
+{
+    QElapsedTimer stopwatch;
+    stopwatch.start();
+
+    for(auto &postings : m_postings)
+        postings.clear();
+
+    // Going through the rows in order leaves every list sorted.
+
+    const TrackStore::Id rows = TrackStore::instance()->rowCount();
+    for(TrackStore::Id id = 1; id < rows; ++id)
+        add(id);
+
+    for(auto &postings : m_postings) {
+        for(auto &list : postings)
+            list.tracks.squeeze();
+    }
+
+    m_staleCount = 0;
+    m_built = true;
+
+    qCDebug(JUK_LOG) << "Built the search index in" << stopwatch.elapsed() << "ms";
+}
+
+void SearchIndex::add(TrackStore::Id id)
+{
+    const TrackStore *store = TrackStore::instance();
+
+    for(int slot = 0; slot < columnCount; ++slot) {
+        QHash<Trigram, Postings> &postings = m_postings[slot];
+
+        forEachTrigram(columnText(store, id, slot), [&postings, id](Trigram trigram) {
+            Postings &list = postings[trigram];
+
+            // Repeats of a trigram within the same text are the common case.
+            if(!list.tracks.isEmpty() && list.tracks.last() == id)
+                return;
+
+            if(!list.tracks.isEmpty() && list.tracks.last() > id)
+                list.sorted = false;
+
+            list.tracks.append(id);
+        });
+    }
+}
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_SEARCHINDEX_H
+#define JUK_SEARCHINDEX_H
+
+#include <QHash>
+#include <QVector>
+
+#include "trackstore.h"
+
+class QString;
+
+/**
+ * An inverted index from the trigrams (sequences of three characters, case
+ * folded) of the title, artist, album, genre and comment of every track to the
+ * tracks containing them, used to narrow searches down without looking at
+ * every track.
+ *
+ * The index may list a track for a trigram it no longer contains (changes only
+ * ever add to it, and it's rebuilt once enough have piled up) so the text of
+ * the tracks it returns must still be checked.  It never misses a track.
+ *
+ * CollectionList keeps it up to date.  This is only to be used from the GUI
+ * thread.
+ */
+class SearchIndex
+{
+public:
+    static SearchIndex *instance();
+
+    /**
+     * Returns true if \p column (a PlaylistItem::ColumnType) is indexed.
+     */
+    static bool isIndexedColumn(int column);
+
+    /**
+     * To be called whenever the metadata of track \p id in the TrackStore has
+     * changed.
+     */
+    void update(TrackStore::Id id);
+
+    /**
+     * Sets \p tracks to the sorted ids of the tracks whose \p column may
+     * contain \p text, ignoring case.  Returns false if \p text is too short
+     * to be looked up, in which case every track has to be checked.
+     */
+    bool candidates(int column, const QString &text, QVector<TrackStore::Id> *tracks);
+
+    /**
+     * Goes up with every call to update().
+     */
+    quint32 generation() const { return m_generation; }
+
+    /**
+     * Returns true if track \p id has changed since generation() returned
+     * \p generation, which means earlier candidates() don't cover it.
+     */
+    bool changedSince(TrackStore::Id id, quint32 generation) const
+    {
+        return id < quint32(m_changed.size()) && m_changed.at(id) > generation;
+    }
+
+private:
+    // private to force access through instance()
+    SearchIndex() = default;
+
+    void rebuild();
+    void add(TrackStore::Id id);
+
+private:
+    typedef quint64 Trigram;
+
+    struct Postings
+    {
+        QVector<TrackStore::Id> tracks;
+        bool sorted = true;
+    };
+
+    static const int columnCount = 5;
+
+    QHash<Trigram, Postings> m_postings[columnCount];
+    QVector<quint32> m_changed;
+    quint32 m_generation = 0;
+    int m_staleCount = 0;
+    bool m_built = false;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -71,6 +71,46 @@ void SearchPlaylist::updateItems()
     }
 }
 
+void SearchPlaylist::itemChanged(CollectionListItem *item)
+{
+    // Everything is looked at again anyways.
+    if(dirty())
+        return;
+
+    // The search has already refiltered the item as its data changed.
+
+    bool matches = false;
+    const PlaylistList playlists = m_search->playlists();
+
+    for(Playlist *playlist : playlists) {
+        PlaylistItem *source = item->itemForPlaylist(playlist);
+        if(!source)
+            continue;
+
+        QModelIndex index = playlist->indexOf(source);
+        if(m_search->checkItem(&index)) {
+            matches = true;
+            break;
+        }
+    }
+
+    setItemIncluded(item, matches);
+}
+
+void SearchPlaylist::setItemIncluded(CollectionListItem *item, bool included)
+{
+    PlaylistItem *current = item->itemForPlaylist(this);
+
+    if(included && !current) {
+        const int count = topLevelItemCount();
+        auto last = count > 0 ? static_cast<PlaylistItem *>(topLevelItem(count - 1)) : nullptr;
+
+        createItems(PlaylistItemList{item}, last);
+    }
+    else if(!included && current)
+        clearItem(current);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // helper functions
@@ -41,6 +41,18 @@ protected:
      */
     virtual void updateItems() override;
 
+    /**
+     * Adds or removes \p item depending on whether it still matches the
+     * search, without going over the other items.
+     */
+    virtual void itemChanged(CollectionListItem *item) override;
+
+    /**
+     * Adds \p item to the end of the list if \p included and it isn't there
+     * yet, removes it if not \p included.
+     */
+    void setItemIncluded(CollectionListItem *item, bool included);
+
 private:
     PlaylistSearch* m_search;
 };
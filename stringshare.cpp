@@ -16,33 +16,62 @@
 #include "stringshare.h"
 
 #include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QString>
 
-const int SIZE = 8191;
+#include <atomic>
 
-static unsigned num_attempts = 0;
-static unsigned num_hits     = 0;
+// Tags are read (and their strings shared) from several threads at once, so
+// the pool is split into shards by hash, each with its own lock, to keep the
+// threads from contending for one lock.
+const int SHARD_COUNT = 64;
+
+// A shard is swept for strings nobody uses any longer whenever it has grown
+// to twice its size after the last sweep (but not before it has this many).
+const int MIN_SWEEP_SIZE = 256;
+
+static std::atomic<unsigned> num_attempts { 0 };
+static std::atomic<unsigned> num_hits     { 0 };
+static std::atomic<quint64>  bytes_saved  { 0 };
 
 /**
- * We store the strings in a simple direct-mapped (i.e. no collision handling,
- * just replace) hash, which contain strings or null objects. This costs only
- * 4 bytes per slot on 32-bit archs, so with the default constant size we only
- * really use 40K or so.
+ * Every string is kept in a set, so unlike a direct-mapped table two strings
+ * that happen to hash to the same slot don't keep throwing each other out,
+ * and an artist shared by the first and the last track of a large collection
+ * is still only stored once.
  *
- * The end result is that many strings end up pointing to the same underlying data
- * object, instead of each one having its own little copy.
- *
- * More importantly, the way the tryShare function is coded ensures that
- * most-recently inserted text stays in the cache, which gives a better chance
- * of continuing to share data. (Even if something old ("foo") that was shared
- * gets kicked out, all the other "foo"s will still be sharing each other's
- * data.
+ * The pool's copy is shared with everything that got it from tryShare(), so
+ * QString's own reference count tells us when the pool holds the only copy
+ * left.  Those are removed when a shard is swept, which means the pool never
+ * holds much more than the strings actually in use.
  */
 
+struct Shard
+{
+    QMutex lock;
+    QSet<QString> strings;
+    int sweepSize = MIN_SWEEP_SIZE;
+};
+
 struct StringShare::Data
 {
-    QString  qstringHash [SIZE];
+    Shard shards [SHARD_COUNT];
 };
 
+static void sweep(Shard &shard)
+{
+    for(auto it = shard.strings.begin(); it != shard.strings.end(); ) {
+        if(it->isDetached())
+            it = shard.strings.erase(it);
+        else
+            ++it;
+    }
+
+    shard.sweepSize = qMax(MIN_SWEEP_SIZE, int(shard.strings.size()) * 2);
+}
+
 StringShare::Data* StringShare::data()
 {
     static Data *data = new Data;
@@ -51,30 +80,55 @@ StringShare::Data* StringShare::data()
 
 QString StringShare::tryShare(const QString& in)
 {
-    uint index = qHash(in) % SIZE;
+    if(in.isEmpty())
+        return in;
+
+    num_attempts.fetch_add(1, std::memory_order_relaxed);
 
-    num_attempts++;
+    Shard &shard = data()->shards[qHash(in) % SHARD_COUNT];
+    QMutexLocker locker(&shard.lock);
 
-    Data* dat = data();
-    if (dat->qstringHash[index] == in) {
+    const auto it = shard.strings.constFind(in);
+    if(it != shard.strings.constEnd()) {
         // Match
-        num_hits++;
-        return dat->qstringHash[index];
-    } else {
-        // Else replace whatever was there before
-        dat->qstringHash[index] = in;
-        return in;
+        num_hits.fetch_add(1, std::memory_order_relaxed);
+        if(it->constData() != in.constData())
+            bytes_saved.fetch_add(in.size() * sizeof(QChar), std::memory_order_relaxed);
+        return *it;
     }
+
+    if(shard.strings.size() >= shard.sweepSize)
+        sweep(shard);
+
+    shard.strings.insert(in);
+    return in;
 }
 
 unsigned StringShare::numHits()
 {
-    return num_hits;
+    return num_hits.load(std::memory_order_relaxed);
 }
 
 unsigned StringShare::numAttempts()
 {
-    return num_attempts;
+    return num_attempts.load(std::memory_order_relaxed);
+}
+
+quint64 StringShare::bytesSaved()
+{
+    return bytes_saved.load(std::memory_order_relaxed);
+}
+
+int StringShare::size()
+{
+    int count = 0;
+
+    for(auto &shard : data()->shards) {
+        QMutexLocker locker(&shard.lock);
+        count += shard.strings.size();
+    }
+
+    return count;
 }
 
 // vim: set et sw=4 tw=0 sta:
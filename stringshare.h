@@ -17,11 +17,17 @@
 #ifndef STRING_SHARE_H
 #define STRING_SHARE_H
 
+#include <QtGlobal>
+
 class QString;
 
 /**
- * This class attempts to normalize repeated occurrences of strings to use
- *the same shared object, if possible, by using a small hash
+ * This class normalizes repeated occurrences of strings to use the same
+ * shared object by keeping one copy of every string it has been given in a
+ * pool.  The returned QString is itself the handle: it stays the same for as
+ * long as anything holds on to it, and strings nobody else holds any longer
+ * are dropped from the pool from time to time.  It is safe to use from
+ * multiple threads.
  */
 class StringShare
 {
@@ -31,6 +37,17 @@ public:
     static unsigned numHits();
     static unsigned numAttempts();
 
+    /**
+     * Returns the number of bytes of string data that didn't have to be kept
+     * around because an equal string was already shared.
+     */
+    static quint64 bytesSaved();
+
+    /**
+     * Returns the number of distinct strings currently pooled.
+     */
+    static int size();
+
 private:
     static Data* data();
 };
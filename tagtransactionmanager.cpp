@@ -20,9 +20,11 @@
 #include <KLocalizedString>
 
 #include <QAction>
-#include <QApplication>
 #include <QDir>
 #include <QFileInfo>
+#include <QPointer>
+#include <QSet>
+#include <QVector>
 
 #include "playlistitem.h"
 #include "collectionlist.h"
@@ -128,6 +130,11 @@ bool TagTransactionManager::processChangeList(bool undo)
 
     emit signalAboutToModifyTags();
 
+    // Have the collection announce all of the changed tracks at once, and
+    // tell each of the playlists they're in only once at the end.
+    CollectionList::instance()->beginTransaction();
+    QSet<Playlist *> changedPlaylists;
+
     for(; it != end; ++it) {
         PlaylistItem *item = (*it).item();
         const Tag *tag = (*it).tag();
@@ -147,10 +154,7 @@ bool TagTransactionManager::processChangeList(bool undo)
 
             item->setFile(tag->fileName());
             item->refreshFromDisk();
-            //FIXME repaint
-            //item->repaint();
-            item->playlist()->playlistItemsChanged();
-            item->playlist()->update();
+            changedPlaylists.insert(item->playlist());
         }
         else {
             Tag *errorTag = item->file().tag();
@@ -161,8 +165,22 @@ bool TagTransactionManager::processChangeList(bool undo)
 
             errorItems.append(str);
         }
+    }
+
+    // Committing can take away tree view category playlists emptied by the
+    // changes.
+    QVector<QPointer<Playlist>> playlists;
+    playlists.reserve(changedPlaylists.size());
+    for(Playlist *playlist : std::as_const(changedPlaylists))
+        playlists.append(playlist);
+
+    CollectionList::instance()->commitTransaction();
 
-        qApp->processEvents();
+    for(const auto &playlist : std::as_const(playlists)) {
+        if(!playlist)
+            continue;
+        playlist->playlistItemsChanged();
+        playlist->update();
     }
 
     undo ? m_undoList.clear() : m_list.clear();
@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stringshare.h"
+#include <QTest>
+#include <QString>
+#include <QVector>
+
+#include <thread>
+#include <vector>
+
+class StringShareTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSharing();
+    void testManyStrings();
+    void testThreads();
+    void testEviction();
+};
+
+// Builds an equal string with its own copy of the data.
+static QString copyOf(const QString &str)
+{
+    return QString(str.constData(), str.size());
+}
+
+void StringShareTest::testSharing()
+{
+    const QString first = StringShare::tryShare(copyOf("The Chemical Brothers"));
+    const QString second = StringShare::tryShare(copyOf("The Chemical Brothers"));
+
+    QCOMPARE(first, second);
+    QCOMPARE(first.constData(), second.constData());
+    QVERIFY(StringShare::bytesSaved() >= quint64(second.size() * sizeof(QChar)));
+
+    QVERIFY(StringShare::tryShare(QString()).isNull());
+}
+
+void StringShareTest::testManyStrings()
+{
+    // A direct-mapped table would have thrown the first string out long
+    // before we get back to it.
+
+    QVector<QString> held;
+    for(int i = 0; i < 50000; ++i)
+        held.append(StringShare::tryShare(QStringLiteral("Album %1").arg(i)));
+
+    for(int i = 0; i < held.size(); i += 997) {
+        const QString again = StringShare::tryShare(QStringLiteral("Album %1").arg(i));
+        QCOMPARE(again.constData(), held.at(i).constData());
+    }
+}
+
+void StringShareTest::testThreads()
+{
+    const int threadCount = 8;
+    const int stringCount = 1000;
+
+    std::vector<QVector<QString>> results(threadCount);
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([t, &results]() {
+            for(int i = 0; i < stringCount; ++i) {
+                const int n = (i * (t + 1)) % stringCount;
+                results[t].append(StringShare::tryShare(QStringLiteral("Genre %1").arg(n)));
+            }
+        });
+    }
+
+    for(auto &thread : threads)
+        thread.join();
+
+    for(int t = 0; t < threadCount; ++t) {
+        for(const QString &str : results[t]) {
+            const QString shared = StringShare::tryShare(copyOf(str));
+            QCOMPARE(shared.constData(), str.constData());
+        }
+    }
+}
+
+void StringShareTest::testEviction()
+{
+    const int before = StringShare::size();
+
+    for(int i = 0; i < 100000; ++i)
+        StringShare::tryShare(QStringLiteral("Comment %1").arg(i));
+
+    // Nothing holds on to those, so most of them must have been swept.
+    QVERIFY(StringShare::size() - before < 50000);
+}
+
+QTEST_GUILESS_MAIN(StringShareTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "stringsharetest.moc"
@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediafiles.h"
+#include "stringshare.h"
+#include <QTest>
+#include <QDirIterator>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <memory>
+
+#include <tag.h>
+#include <tfile.h>
+
+// Reads the tags of a music folder with more and more threads, the way the
+// folder scanner does, to see that tag reading scales with the cores.  Point
+// JUK_BENCHMARK_MUSIC at a folder of music files to run it, e.g.
+//
+//   JUK_BENCHMARK_MUSIC=~/Music ./tagreadbenchmark -median 3
+
+class TagReadBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void benchmarkRead_data();
+    void benchmarkRead();
+
+private:
+    QStringList m_files;
+};
+
+static void readTag(const QString &fileName)
+{
+    std::unique_ptr<TagLib::File> file(MediaFiles::fileFactoryByType(fileName));
+    if(!file || !file->isValid() || !file->tag())
+        return;
+
+    // As Tag does with what it reads.
+    StringShare::tryShare(TStringToQString(file->tag()->artist()));
+    StringShare::tryShare(TStringToQString(file->tag()->album()));
+    StringShare::tryShare(TStringToQString(file->tag()->genre()));
+}
+
+void TagReadBenchmark::initTestCase()
+{
+    const QString dir = qEnvironmentVariable("JUK_BENCHMARK_MUSIC");
+    if(dir.isEmpty())
+        QSKIP("Set JUK_BENCHMARK_MUSIC to a folder of music files to run this");
+
+    MediaFiles::initializeTagLib();
+
+    QDirIterator it(dir, QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext()) {
+        const QString fileName = it.next();
+        if(MediaFiles::isMediaFile(fileName))
+            m_files.append(fileName);
+    }
+
+    if(m_files.isEmpty())
+        QSKIP("No music files found in JUK_BENCHMARK_MUSIC");
+
+    // Have the files in the page cache, so that the first run isn't the only
+    // one waiting for the disk.
+    for(const QString &fileName : std::as_const(m_files))
+        readTag(fileName);
+}
+
+void TagReadBenchmark::benchmarkRead_data()
+{
+    QTest::addColumn<int>("threads");
+
+    const int cores = QThread::idealThreadCount();
+    for(int threads = 1; threads < cores; threads *= 2)
+        QTest::addRow("%d threads", threads) << threads;
+    QTest::addRow("%d threads", cores) << cores;
+}
+
+void TagReadBenchmark::benchmarkRead()
+{
+    QFETCH(int, threads);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    QBENCHMARK {
+        QtConcurrent::blockingMap(&pool, m_files, &readTag);
+    }
+}
+
+QTEST_GUILESS_MAIN(TagReadBenchmark)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "tagreadbenchmark.moc"
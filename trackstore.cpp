@@ -0,0 +1,284 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trackstore.h"
+
+#include <QFontMetrics>
+
+#include <algorithm>
+#include <limits>
+
+#include "juktag.h"
+#include "playlistitem.h"
+
+const int TrackStore::columnCount = PlaylistItem::FullPathColumn + 1;
+
+static quint16 clampToUShort(int value)
+{
+    return quint16(qBound(0, value, int(std::numeric_limits<quint16>::max())));
+}
+
+// Matches the comparisons PlaylistItem makes for the columns without keys.
+static QCollator naturalCollator()
+{
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    return collator;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// public methods
+////////////////////////////////////////////////////////////////////////////////
+
+TrackStore *TrackStore::instance()
+{
+    static TrackStore store;
+    return &store;
+}
+
+TrackStore::Id TrackStore::allocate()
+{
+    if(!m_freeIds.isEmpty())
+        return m_freeIds.takeLast();
+
+    const Id id = m_titles.size();
+
+    m_titles.append(QString());
+    m_foldedTitles.append(QString());
+    m_titleKeys.push_back(m_emptyKey);
+    m_artists.append(invalidId);
+    m_albums.append(invalidId);
+    m_genres.append(invalidId);
+    m_comments.append(invalidId);
+    m_tracks.append(0);
+    m_years.append(0);
+    m_bitrates.append(0);
+    m_seconds.append(0);
+    m_widths.resize(m_widths.size() + columnCount);
+
+    return id;
+}
+
+void TrackStore::release(Id id)
+{
+    if(id == invalidId)
+        return;
+
+    m_titles[id] = QString();
+    m_foldedTitles[id] = QString();
+    m_titleKeys[id] = m_emptyKey;
+    releaseString(m_artists.at(id), m_artists, id);
+    releaseString(m_albums.at(id), m_albums, id);
+    releaseString(m_genres.at(id), m_genres, id);
+    releaseString(m_comments.at(id), m_comments, id);
+    m_tracks[id] = 0;
+    m_years[id] = 0;
+    m_bitrates[id] = 0;
+    m_seconds[id] = 0;
+    std::fill_n(m_widths.begin() + id * columnCount, columnCount, 0);
+
+    m_freeIds.append(id);
+}
+
+void TrackStore::setTag(Id id, const Tag &tag)
+{
+    // Intern the new strings before dropping the old ones so that a string
+    // which didn't change never leaves the table.
+
+    const StringId artist = intern(tag.artist());
+    const StringId album = intern(tag.album());
+    const StringId genre = intern(tag.genre());
+    const StringId comment = intern(tag.comment());
+
+    releaseString(m_artists.at(id), m_artists, id);
+    releaseString(m_albums.at(id), m_albums, id);
+    releaseString(m_genres.at(id), m_genres, id);
+    releaseString(m_comments.at(id), m_comments, id);
+
+    if(m_titles.at(id) != tag.title()) {
+        m_titles[id] = tag.title();
+        m_foldedTitles[id] = fold(tag.title());
+        m_titleKeys[id] = m_collator.sortKey(tag.title());
+    }
+    m_artists[id] = artist;
+    m_albums[id] = album;
+    m_genres[id] = genre;
+    m_comments[id] = comment;
+    m_tracks[id] = clampToUShort(tag.track());
+    m_years[id] = clampToUShort(tag.year());
+    m_bitrates[id] = clampToUShort(tag.bitrate());
+    m_seconds[id] = quint32(qMax(0, tag.seconds()));
+}
+
+Tag TrackStore::tag(Id id, const QString &fileName) const
+{
+    Tag t(fileName, true);
+
+    t.m_title = title(id);
+    t.m_artist = artist(id);
+    t.m_album = album(id);
+    t.m_genre = genre(id);
+    t.m_comment = comment(id);
+    t.m_track = track(id);
+    t.m_year = year(id);
+    t.m_seconds = seconds(id);
+    t.m_bitrate = bitrate(id);
+    t.m_lengthString = lengthString(id);
+
+    return t;
+}
+
+// static
+QString TrackStore::lengthString(int seconds)
+{
+    const int s = seconds % 60;
+    const int minutes = (seconds - s) / 60;
+
+    return QString::number(minutes) + (s >= 10 ? ":" : ":0") + QString::number(s);
+}
+
+// static
+QString TrackStore::fold(const QString &str)
+{
+    const auto first = std::find_if(str.cbegin(), str.cend(),
+        [](QChar c) { return c.toCaseFolded() != c; });
+
+    if(first == str.cend())
+        return str;
+
+    QString folded = str;
+    for(auto it = folded.begin() + (first - str.cbegin()); it != folded.end(); ++it)
+        *it = it->toCaseFolded();
+
+    return folded;
+}
+
+void TrackStore::setWidth(Id id, int column, int width)
+{
+    m_widths[id * columnCount + column] = clampToUShort(width);
+}
+
+int TrackStore::stringWidth(StringId id, const QFontMetrics &metrics)
+{
+    // Not measured yet is -1, the empty string is always 0.
+
+    int &width = m_stringWidths[id];
+    if(width < 0)
+        width = metrics.horizontalAdvance(m_strings.at(id));
+
+    return width;
+}
+
+int TrackStore::textWidth(const QString &text, const QFontMetrics &metrics)
+{
+    if(text.isEmpty())
+        return 0;
+
+    auto it = m_textWidths.find(text);
+    if(it == m_textWidths.end())
+        it = m_textWidths.insert(text, metrics.horizontalAdvance(text));
+
+    return *it;
+}
+
+void TrackStore::clearTextWidths()
+{
+    m_stringWidths.fill(-1);
+    m_stringWidths[invalidId] = 0;
+    m_textWidths.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+TrackStore::TrackStore()
+  : m_collator(naturalCollator())
+  , m_emptyKey(m_collator.sortKey(QString()))
+{
+    // Row 0 and string 0 are never handed out: the first stands in for
+    // "no track" and the second is the empty string.
+
+    m_titles.append(QString());
+    m_foldedTitles.append(QString());
+    m_titleKeys.push_back(m_emptyKey);
+    m_artists.append(invalidId);
+    m_albums.append(invalidId);
+    m_genres.append(invalidId);
+    m_comments.append(invalidId);
+    m_tracks.append(0);
+    m_years.append(0);
+    m_bitrates.append(0);
+    m_seconds.append(0);
+    m_widths.resize(columnCount);
+
+    m_strings.append(QString());
+    m_foldedStrings.append(QString());
+    m_stringKeys.push_back(m_emptyKey);
+    m_stringRefs.append(0);
+    m_stringWidths.append(0);
+}
+
+TrackStore::StringId TrackStore::intern(const QString &str)
+{
+    if(str.isEmpty())
+        return invalidId;
+
+    const auto it = m_stringIds.constFind(str);
+    if(it != m_stringIds.constEnd()) {
+        ++m_stringRefs[*it];
+        return *it;
+    }
+
+    StringId id;
+    if(!m_freeStringIds.isEmpty()) {
+        id = m_freeStringIds.takeLast();
+        m_strings[id] = str;
+        m_foldedStrings[id] = fold(str);
+        m_stringKeys[id] = m_collator.sortKey(str);
+        m_stringRefs[id] = 1;
+        m_stringWidths[id] = -1;
+    }
+    else {
+        id = m_strings.size();
+        m_strings.append(str);
+        m_foldedStrings.append(fold(str));
+        m_stringKeys.push_back(m_collator.sortKey(str));
+        m_stringRefs.append(1);
+        m_stringWidths.append(-1);
+    }
+
+    m_stringIds.insert(m_strings.at(id), id);
+
+    return id;
+}
+
+void TrackStore::releaseString(StringId id, QVector<StringId> &column, Id track)
+{
+    column[track] = invalidId;
+
+    if(id == invalidId || --m_stringRefs[id] > 0)
+        return;
+
+    m_stringIds.remove(m_strings.at(id));
+    m_strings[id] = QString();
+    m_foldedStrings[id] = QString();
+    m_stringKeys[id] = m_emptyKey;
+    m_freeStringIds.append(id);
+}
+
+// vim: set et sw=4 tw=0 sta:
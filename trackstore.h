@@ -0,0 +1,190 @@
+/**
+ * Copyright (C) 2026 The JuK developers
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_TRACKSTORE_H
+#define JUK_TRACKSTORE_H
+
+#include <QCollator>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+class Tag;
+class QFontMetrics;
+
+/**
+ * Holds the metadata of every track in the collection, one column per field.
+ * Each track is a row with a small integer id (reused once freed), artists,
+ * albums, genres and comments are stored once no matter how many tracks share
+ * them, and the numbers are packed.
+ *
+ * A Tag is only kept around for a track while something asks for one (see
+ * FileHandle::tag()), everything that goes over all of the tracks (drawing,
+ * sorting, playing time) reads from here instead.
+ *
+ * Only the GUI thread changes the store.  The const methods may also be called
+ * from other threads while the GUI thread waits for them to finish, as
+ * Playlist::prepareSort() does, since nothing can change the store then.
+ */
+class TrackStore
+{
+public:
+    typedef quint32 Id;
+    typedef quint32 StringId;
+
+    /**
+     * Never used for a track, the empty string always has this id as well.
+     */
+    static constexpr Id invalidId = 0;
+
+    static TrackStore *instance();
+
+    Id allocate();
+    void release(Id id);
+
+    void setTag(Id id, const Tag &tag);
+
+    /**
+     * Returns a new Tag for \p fileName with the metadata of track \p id.
+     */
+    Tag tag(Id id, const QString &fileName) const;
+
+    QString title(Id id) const { return m_titles.at(id); }
+    QString artist(Id id) const { return m_strings.at(m_artists.at(id)); }
+    QString album(Id id) const { return m_strings.at(m_albums.at(id)); }
+    QString genre(Id id) const { return m_strings.at(m_genres.at(id)); }
+    QString comment(Id id) const { return m_strings.at(m_comments.at(id)); }
+
+    /**
+     * Tracks share the same id for the same string, which makes these a
+     * cheap way to group tracks.
+     */
+    StringId artistId(Id id) const { return m_artists.at(id); }
+    StringId albumId(Id id) const { return m_albums.at(id); }
+    StringId genreId(Id id) const { return m_genres.at(id); }
+    StringId commentId(Id id) const { return m_comments.at(id); }
+
+    /**
+     * The case folded text, see fold(), made once when the text was stored.
+     */
+    QString foldedTitle(Id id) const { return m_foldedTitles.at(id); }
+    QString foldedString(StringId id) const { return m_foldedStrings.at(id); }
+
+    /**
+     * Returns \p str with every character case folded on its own, so the
+     * result is as long as \p str and both compare equal ignoring case where
+     * they are equal after folding.  \p str itself is returned (sharing its
+     * data) if there is nothing to fold.
+     */
+    static QString fold(const QString &str);
+
+    /**
+     * These compare like a natural, case insensitive QCollator would, but
+     * use sort keys made once when the text was stored.
+     */
+    int compareTitles(Id first, Id second) const
+    {
+        return m_titleKeys[first].compare(m_titleKeys[second]);
+    }
+
+    int compareStrings(StringId first, StringId second) const
+    {
+        return first == second ? 0 : m_stringKeys[first].compare(m_stringKeys[second]);
+    }
+
+    int track(Id id) const { return m_tracks.at(id); }
+    int year(Id id) const { return m_years.at(id); }
+    int bitrate(Id id) const { return m_bitrates.at(id); }
+    int seconds(Id id) const { return m_seconds.at(id); }
+    QString lengthString(Id id) const { return lengthString(m_seconds.at(id)); }
+
+    static QString lengthString(int seconds);
+
+    /**
+     * The width of the text of the given PlaylistItem column (not counting
+     * any column offset) as last drawn.
+     */
+    int width(Id id, int column) const { return m_widths.at(id * columnCount + column); }
+    void setWidth(Id id, int column, int width);
+
+    /**
+     * Returns the width of string \p id in the font of \p metrics.  Each
+     * string is only measured once, however many tracks share it, so the
+     * caller has to call clearTextWidths() when the font changes.
+     */
+    int stringWidth(StringId id, const QFontMetrics &metrics);
+
+    /**
+     * The same for short texts which aren't stored as strings but repeat a
+     * lot, like track numbers, years and lengths.
+     */
+    int textWidth(const QString &text, const QFontMetrics &metrics);
+
+    void clearTextWidths();
+
+    /**
+     * Returns the number of tracks currently stored.
+     */
+    int count() const { return m_titles.size() - m_freeIds.size() - 1; }
+
+    /**
+     * Returns one more than the highest id handed out so far.  Rows that are
+     * not in use in between are empty.
+     */
+    Id rowCount() const { return m_titles.size(); }
+
+private:
+    // private to force access through instance()
+    TrackStore();
+
+    StringId intern(const QString &str);
+    void releaseString(StringId id, QVector<StringId> &column, Id track);
+
+private:
+    static const int columnCount;
+
+    QCollator m_collator;
+    QCollatorSortKey m_emptyKey;
+
+    QVector<QString> m_titles;
+    QVector<QString> m_foldedTitles;
+    std::vector<QCollatorSortKey> m_titleKeys;
+    QVector<StringId> m_artists;
+    QVector<StringId> m_albums;
+    QVector<StringId> m_genres;
+    QVector<StringId> m_comments;
+    QVector<quint16> m_tracks;
+    QVector<quint16> m_years;
+    QVector<quint16> m_bitrates;
+    QVector<quint32> m_seconds;
+    QVector<quint16> m_widths;
+    QVector<Id> m_freeIds;
+
+    QVector<QString> m_strings;
+    QVector<QString> m_foldedStrings;
+    std::vector<QCollatorSortKey> m_stringKeys;
+    QVector<quint32> m_stringRefs;
+    QVector<int> m_stringWidths;
+    QHash<QString, int> m_textWidths;
+    QHash<QString, StringId> m_stringIds;
+    QVector<StringId> m_freeStringIds;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
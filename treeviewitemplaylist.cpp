@@ -21,6 +21,9 @@
 
 #include <QStringList>
 
+#include <algorithm>
+#include <utility>
+
 #include "collectionlist.h"
 #include "juktag.h"
 #include "playlistitem.h"
@@ -91,4 +94,48 @@ void TreeViewItemPlaylist::retag(const QStringList &files, Playlist *)
     }
 }
 
+void TreeViewItemPlaylist::updateItems()
+{
+    // Each distinct value only has to be checked once, rather than the value
+    // of every track.
+
+    const CollectionList *collection = CollectionList::instance();
+    const PlaylistSearch::Component component = playlistSearch()->components().constFirst();
+    const TagTracksDict &tagTracks = collection->tagTracks(m_columnType);
+
+    QVector<TrackStore::Id> tracks;
+
+    for(auto it = tagTracks.cbegin(); it != tagTracks.cend(); ++it) {
+        if(component.matchesText(it.key())) {
+            for(TrackStore::Id id : it.value())
+                tracks.append(id);
+        }
+    }
+
+    // Keep the order stable from one update to the next.
+    std::sort(tracks.begin(), tracks.end());
+
+    PlaylistItemList items;
+    items.reserve(tracks.size());
+
+    for(TrackStore::Id id : std::as_const(tracks)) {
+        CollectionListItem *item = collection->itemForTrack(id);
+        if(item)
+            items.append(item);
+    }
+
+    synchronizeItemsTo(items);
+}
+
+void TreeViewItemPlaylist::itemChanged(CollectionListItem *item)
+{
+    if(dirty())
+        return;
+
+    const PlaylistSearch::Component component = playlistSearch()->components().constFirst();
+    const QString value = PlaylistItem::storeText(item->storeId(), m_columnType);
+
+    setItemIncluded(item, component.matchesText(value));
+}
+
 // vim: set et sw=4 tw=0 sta:
@@ -36,6 +36,18 @@ public:
 signals:
     void signalTagsChanged();
 
+protected:
+    /**
+     * Reimplemented to take the tracks from the CollectionList's groups of
+     * tracks by tag instead of running the search over the whole collection.
+     */
+    virtual void updateItems() override;
+
+    /**
+     * Reimplemented to only look at the changed tag of \p item.
+     */
+    virtual void itemChanged(CollectionListItem *item) override;
+
 private:
     PlaylistItem::ColumnType m_columnType;
 };
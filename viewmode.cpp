@@ -199,16 +199,12 @@ void TreeViewMode::removeItem(const QString &item, unsigned column)
     if(!m_treeViewItems.contains(itemKey))
         return;
 
-    TreeViewItemPlaylist *itemPlaylist = m_treeViewItems.value(itemKey, 0);
-
     if(m_dynamicListsFrozen) {
         m_pendingItemsToRemove << itemKey;
         return;
     }
 
-    m_treeViewItems.remove(itemKey);
-    itemPlaylist->deleteLater();
-    emit signalPlaylistDestroyed(itemPlaylist);
+    deleteTreeViewItem(m_treeViewItems.take(itemKey));
 }
 
 void TreeViewMode::addItems(const QStringList &items, unsigned column)
@@ -228,6 +224,37 @@ void TreeViewMode::addItems(const QStringList &items, unsigned column)
         return;
     }
 
+    QString itemKey;
+    PlaylistBox::Item *itemParent = m_searchCategories.value(searchCategory, 0);
+
+    // The playlists are only made once they're selected, see
+    // setupItemPlaylist().
+
+    for(const QString &item : items) {
+        itemKey = searchCategory + item;
+
+        if(m_treeViewItems.contains(itemKey))
+            continue;
+
+        m_treeViewItems.insert(itemKey, new PlaylistBox::Item(itemParent, "audio-midi", item));
+    }
+}
+
+void TreeViewMode::setupItemPlaylist(PlaylistBox::Item *item)
+{
+    const auto parent = static_cast<PlaylistBox::Item *>(item->QTreeWidgetItem::parent());
+    const QString searchCategory = m_searchCategories.key(parent);
+
+    int column;
+    if(searchCategory == "artists")
+        column = PlaylistItem::ArtistColumn;
+    else if(searchCategory == "genres")
+        column = PlaylistItem::GenreColumn;
+    else if(searchCategory == "albums")
+        column = PlaylistItem::AlbumColumn;
+    else
+        return; // Not one of ours, or one of the categories themselves.
+
     ColumnList columns;
     columns.append(column);
 
@@ -236,27 +263,19 @@ void TreeViewMode::addItems(const QStringList &items, unsigned column)
         mode = PlaylistSearch::Component::Exact;
 
     PlaylistSearch::ComponentList components;
+    components.append(PlaylistSearch::Component(item->text(), false, columns, mode));
+
     PlaylistList playlists;
     playlists.append(CollectionList::instance());
 
-    QString itemKey;
-    PlaylistBox::Item *itemParent = m_searchCategories.value(searchCategory, 0);
+    auto search = new PlaylistSearch(playlists, components, PlaylistSearch::MatchAny);
 
-    for(const QString &item : items) {
-        itemKey = searchCategory + item;
+    TreeViewItemPlaylist *p = new TreeViewItemPlaylist(playlistBox(), *search, item->text());
 
-        if(m_treeViewItems.contains(itemKey))
-            continue;
-
-        components.clear();
-        components.append(PlaylistSearch::Component(item, false, columns, mode));
-
-        PlaylistSearch s(playlists, components, PlaylistSearch::MatchAny);
-
-        TreeViewItemPlaylist *p = new TreeViewItemPlaylist(playlistBox(), s, item);
-        playlistBox()->setupPlaylist(p, "audio-midi", itemParent);
-        m_treeViewItems.insert(itemKey, p);
-    }
+    // Categories come and go with the collection, don't leave their searches
+    // behind when they do.
+    search->setParent(p);
+    playlistBox()->attachPlaylist(p, item);
 }
 
 void TreeViewMode::setDynamicListsFrozen(bool frozen)
@@ -267,8 +286,9 @@ void TreeViewMode::setDynamicListsFrozen(bool frozen)
         return;
 
     for(const QString &pendingItem : std::as_const(m_pendingItemsToRemove)) {
-        m_treeViewItems[pendingItem]->deleteLater();
-        m_treeViewItems.remove(pendingItem);
+        PlaylistBox::Item *item = m_treeViewItems.take(pendingItem);
+        if(item)
+            deleteTreeViewItem(item);
     }
 
     m_pendingItemsToRemove.clear();
@@ -289,4 +309,19 @@ void TreeViewMode::setupDynamicPlaylists()
     m_searchCategories.insert("genres", i);
 }
 
+void TreeViewMode::deleteTreeViewItem(PlaylistBox::Item *item)
+{
+    Playlist *playlist = item->playlist();
+
+    if(!playlist) {
+        playlistBox()->removeItem(item);
+        return;
+    }
+
+    // The item goes away with its playlist.
+
+    playlist->deleteLater();
+    emit signalPlaylistDestroyed(playlist);
+}
+
 // vim: set et sw=4 tw=0 sta:
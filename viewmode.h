@@ -77,6 +77,16 @@ public:
         Q_UNUSED(column);
     }
 
+    /**
+     * Used for dynamic view modes, which only create the playlist of one of
+     * their items once it's needed.  This is called when \p item, which has
+     * no playlist, is selected.
+     */
+    virtual void setupItemPlaylist(PlaylistBox::Item *item)
+    {
+        Q_UNUSED(item);
+    }
+
 protected:
     PlaylistBox *playlistBox() const { return m_playlistBox; }
     bool visible() const { return m_visible; }
@@ -113,8 +123,6 @@ public:
 
 ////////////////////////////////////////////////////////////////////////////////
 
-class TreeViewItemPlaylist;
-
 class TreeViewMode final : public CompactViewMode
 {
     Q_OBJECT
@@ -130,13 +138,17 @@ public:
 
     virtual void removeItem(const QString &item, unsigned column) override;
     virtual void addItems(const QStringList &items, unsigned column) override;
+    virtual void setupItemPlaylist(PlaylistBox::Item *item) override;
 
 signals:
     void signalPlaylistDestroyed(Playlist*);
 
+private:
+    void deleteTreeViewItem(PlaylistBox::Item *item);
+
 private:
     QMap<QString, PlaylistBox::Item*> m_searchCategories;
-    QMap<QString, TreeViewItemPlaylist*> m_treeViewItems;
+    QMap<QString, PlaylistBox::Item*> m_treeViewItems;
     QStringList m_pendingItemsToRemove;
     bool m_dynamicListsFrozen;
     bool m_setup;